@@ -1,5 +1,8 @@
 uniform mat4 modelView;
 uniform mat4 projection;
+// Set by the fontstash renderer on programs registered with glfonsRegisterProgram(), (1, 1) unless the texture
+// coordinates are atlas texels (FONS_COMPACT_VERTICES).
+uniform vec2 texCoordScale;
 
 attribute vec4 vertexPosition;
 attribute vec2 vertexTexCoord;
@@ -7,9 +10,14 @@ attribute vec4 vertexColor;
 
 varying vec2 interpolatedTexCoord;
 varying vec4 interpolatedColor;
+varying float interpolatedBitmap;
 
 void main() {
   interpolatedColor = vertexColor;
-  interpolatedTexCoord = vertexTexCoord;
+  // Bitmaps drawn by hybrid fonts are tagged with two atlas widths added to s (FONS_HYBRID_BITMAP_TAG), an
+  // untagged s is at most 1.
+  vec2 texCoord = vertexTexCoord * texCoordScale;
+  interpolatedBitmap = step(1.5, texCoord.x);
+  interpolatedTexCoord = vec2(texCoord.x - 2.0 * interpolatedBitmap, texCoord.y);
   gl_Position = projection * modelView * vertexPosition;
 }
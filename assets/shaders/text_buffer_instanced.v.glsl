@@ -0,0 +1,28 @@
+// Draws a text buffer once per instance, scaled, moved and tinted by the instance. Needs instancing (not
+// available on OpenGL ES2).
+uniform mat4 modelView;
+uniform mat4 projection;
+// Set by the fontstash renderer on programs registered with glfonsRegisterProgram(), (1, 1) unless the texture
+// coordinates are atlas texels (FONS_COMPACT_VERTICES).
+uniform vec2 texCoordScale;
+
+attribute vec4 vertexPosition;
+attribute vec2 vertexTexCoord;
+attribute vec4 vertexColor;
+// Position (xy) and scale (z) of the copy.
+attribute vec3 instanceTransform;
+attribute vec4 instanceColor;
+
+varying vec2 interpolatedTexCoord;
+varying vec4 interpolatedColor;
+varying float interpolatedBitmap;
+
+void main() {
+  interpolatedColor = vertexColor * instanceColor;
+  // Bitmaps drawn by hybrid fonts are tagged with two atlas widths added to s (FONS_HYBRID_BITMAP_TAG), an
+  // untagged s is at most 1.
+  vec2 texCoord = vertexTexCoord * texCoordScale;
+  interpolatedBitmap = step(1.5, texCoord.x);
+  interpolatedTexCoord = vec2(texCoord.x - 2.0 * interpolatedBitmap, texCoord.y);
+  gl_Position = projection * modelView * vec4(vertexPosition.xy * instanceTransform.z + instanceTransform.xy, 0.0, 1.0);
+}
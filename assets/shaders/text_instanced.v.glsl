@@ -0,0 +1,26 @@
+// Expands one glyph instance into a quad. Needs gl_VertexID and instancing (not available on OpenGL ES2).
+uniform mat4 modelView;
+uniform mat4 projection;
+uniform vec2 atlasSize;
+
+attribute vec2 instancePosition;
+attribute vec2 instanceSize;
+attribute vec4 instanceTexCoords;
+attribute vec4 instanceColor;
+
+varying vec2 interpolatedTexCoord;
+varying vec4 interpolatedColor;
+varying float interpolatedBitmap;
+
+void main() {
+  // Corners of a triangle strip: (0, 0), (1, 0), (0, 1), (1, 1).
+  vec2 corner = vec2(float(gl_VertexID % 2), float(gl_VertexID / 2));
+
+  interpolatedColor = instanceColor;
+  // Bitmaps drawn by hybrid fonts are tagged with two atlas widths added to s (FONS_HYBRID_BITMAP_TAG), an
+  // untagged s is at most 1.
+  vec2 texCoord = mix(instanceTexCoords.xy, instanceTexCoords.zw, corner) / atlasSize;
+  interpolatedBitmap = step(1.5, texCoord.x);
+  interpolatedTexCoord = vec2(texCoord.x - 2.0 * interpolatedBitmap, texCoord.y);
+  gl_Position = projection * modelView * vec4(instancePosition + instanceSize * corner, 0.0, 1.0);
+}
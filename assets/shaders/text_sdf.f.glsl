@@ -1,7 +1,10 @@
 uniform sampler2D sdf;
+// Maps the atlas distance to the encoding of the font, see fonsGetSdfRemap().
+uniform vec2 sdfRemap;
 
 varying vec2 interpolatedTexCoord;
 varying vec4 interpolatedColor;
+varying float interpolatedBitmap;
 
 const float glyphEdge = 0.5;
 
@@ -21,23 +24,37 @@ float contour(float dist, float edge, float width) {
   return clamp(smoothstep(edge - width, edge + width, dist), 0.0, 1.0);
 }
 
+float getDistance(vec2 texCoords) {
+  return clamp(texture2D(sdf, texCoords).a * sdfRemap.x + sdfRemap.y, 0.0, 1.0);
+}
+
 float getSample(vec2 texCoords, float edge, float width) {
-  return contour(texture2D(sdf, texCoords).a, edge, width);
+  return contour(getDistance(texCoords), edge, width);
 }
 
 void main() {
-  vec4 tex = texture2D(sdf, interpolatedTexCoord);
-  float dist  = tex.a;
+  float coverage = texture2D(sdf, interpolatedTexCoord).a;
+  float dist  = clamp(coverage * sdfRemap.x + sdfRemap.y, 0.0, 1.0);
   float width = fwidth(dist);
   vec4 textColor = clamp(interpolatedColor, 0.0, 1.0);
   float outerEdge = glyphEdge;
 
   #if defined(SUPERSAMPLE)
-    float alpha = contour(dist, outerEdge, width);
-
+    // Derivatives before branching.
     float dscale = 0.354; // half of 1/sqrt2; you can play with this
     vec2 uv = interpolatedTexCoord.xy;
     vec2 duv = dscale * (dFdx(uv) + dFdy(uv));
+  #endif
+
+  // Small text of a hybrid font is a plain bitmap, one lookup is enough.
+  if (interpolatedBitmap > 0.5) {
+    gl_FragColor = vec4(textColor.rgb * textColor.a, textColor.a) * coverage;
+    return;
+  }
+
+  #if defined(SUPERSAMPLE)
+    float alpha = contour(dist, outerEdge, width);
+
     vec4 box = vec4(uv - duv, uv + duv);
 
     float asum = getSample(box.xy, outerEdge, width)
@@ -1,5 +1,7 @@
 
 uniform sampler2D sdf;
+// Maps the atlas distance to the encoding of the font, see fonsGetSdfRemap().
+uniform vec2 sdfRemap;
 uniform float time;
 
 varying vec2 interpolatedTexCoord;
@@ -34,13 +36,16 @@ float contour(float dist, float edge, float width) {
   return clamp(smoothstep(edge - width, edge + width, dist), 0.0, 1.0);
 }
 
+float getDistance(vec2 texCoords) {
+  return clamp(texture2D(sdf, texCoords).a * sdfRemap.x + sdfRemap.y, 0.0, 1.0);
+}
+
 float getSample(vec2 texCoords, float edge, float width) {
-  return contour(texture2D(sdf, texCoords).a, edge, width);
+  return contour(getDistance(texCoords), edge, width);
 }
 
 void main() {
-  vec4 tex = texture2D(sdf, interpolatedTexCoord);
-  float dist  = tex.a;
+  float dist  = getDistance(interpolatedTexCoord);
   float width = fwidth(dist);
   vec4 textColor = clamp(interpolatedColor, 0.0, 1.0);
   float outerEdge = glyphEdge;
@@ -32,9 +32,21 @@ extern "C" {
 
 #define FONS_INVALID -1
 
+// Added to the s texture coordinate of the bitmap quads of hybrid fonts, see fonsSetHybridFont(). Coordinates in
+// the atlas are 0..1 (the right edge included), so shaders take s > 1.5 as tagged.
+#define FONS_HYBRID_BITMAP_TAG 2.0f
+
 enum FONSflags {
 	FONS_ZERO_TOPLEFT = 1,
 	FONS_ZERO_BOTTOMLEFT = 2,
+	// Draw text using renderDrawInstanced (when set), one instance per glyph.
+	FONS_INSTANCED = 4,
+	// Hint for the renderer to upload vertices as FONScompactVertex. Renderers pack the vertices when drawing, so
+	// they can't be written to mapped memory directly and renderMapVertices should return NULL.
+	FONS_COMPACT_VERTICES = 8,
+	// Rasterize all SDF fonts with one distance encoding, so that fonts that differ only by their SDF settings
+	// share the glyphs in the atlas. The shader maps the values to the settings of the font, see fonsGetSdfRemap().
+	FONS_SDF_NORMALIZED = 16,
 };
 
 enum FONSalign {
@@ -49,6 +61,14 @@ enum FONSalign {
 	FONS_ALIGN_BASELINE	= 1<<6, // Default
 };
 
+enum FONSgreeking {
+	FONS_GREEK_NONE = 0, // Default
+	// Draw each word as a solid bar.
+	FONS_GREEK_BARS = 1,
+	// Don't draw the text at all, only advance.
+	FONS_GREEK_SKIP = 2,
+};
+
 enum FONSerrorCode {
 	// Font atlas is full.
 	FONS_ATLAS_FULL = 1,
@@ -60,6 +80,45 @@ enum FONSerrorCode {
 	FONS_STATES_UNDERFLOW = 4,
 };
 
+// Interleaved vertex, 20 bytes.
+struct FONSvertex
+{
+	float x, y;
+	float s, t;
+	unsigned int color;
+};
+typedef struct FONSvertex FONSvertex;
+
+// Vertex packed by renderers for FONS_COMPACT_VERTICES, 12 bytes. Positions are whole pixels (glyph quads are
+// snapped to them) and texture coordinates are in texels. Glyphs scaled from another raster size are not
+// snapped, so SDF tiers, size steps and hybrid fonts can't be used with compact vertices.
+struct FONScompactVertex
+{
+	short x, y;
+	unsigned short s, t;
+	unsigned int color;
+};
+typedef struct FONScompactVertex FONScompactVertex;
+
+// One glyph quad for instanced drawing, 28 bytes. Texture coordinates are in texels.
+struct FONSinstance
+{
+	float x, y;
+	float w, h;
+	unsigned short s0, t0, s1, t1;
+	unsigned int color;
+};
+typedef struct FONSinstance FONSinstance;
+
+// One copy of a text buffer, see fonsDrawTextBufferInstances().
+struct FONStextInstance
+{
+	float x, y;
+	float scale;
+	unsigned int color; // Multiplied with the colors of the text.
+};
+typedef struct FONStextInstance FONStextInstance;
+
 struct FONSparams {
 	int width, height;
 	unsigned char flags;
@@ -67,8 +126,20 @@ struct FONSparams {
 	int (*renderCreate)(void* uptr, int width, int height);
 	int (*renderResize)(void* uptr, int width, int height);
 	void (*renderUpdate)(void* uptr, int* rect, const unsigned char* data);
-	void (*renderDraw)(void* uptr, const float* verts, const float* tcoords, const unsigned int* colors, int nverts);
+	void (*renderDraw)(void* uptr, const FONSvertex* verts, int nverts);
 	void (*renderDelete)(void* uptr);
+	// Optional, returns memory where up to 'nverts' vertices for the next renderDraw call can be written directly
+	// (e.g. a mapped vertex buffer). Returning NULL makes fontstash use its own vertex array.
+	FONSvertex* (*renderMapVertices)(void* uptr, int nverts);
+	// Optional, used to keep text buffers in GPU memory. Text buffers are streamed through renderDraw if not set.
+	int (*renderUpdateBuffer)(void* uptr, int buffer, const FONSvertex* verts, int nverts);
+	void (*renderDrawBuffer)(void* uptr, int buffer);
+	void (*renderDeleteBuffer)(void* uptr, int buffer);
+	// Optional, used with FONS_INSTANCED. Each instance is drawn as a quad from (x,y) to (x+w,y+h).
+	void (*renderDrawInstanced)(void* uptr, const FONSinstance* insts, int ninsts);
+	// Optional, draws a text buffer uploaded with renderUpdateBuffer once per instance. The copies are made on
+	// the CPU and drawn with renderDraw if not set.
+	void (*renderDrawBufferInstances)(void* uptr, int buffer, const FONStextInstance* instances, int ninstances);
 };
 typedef struct FONSparams FONSparams;
 
@@ -92,6 +163,38 @@ struct FONStextIter {
 };
 typedef struct FONStextIter FONStextIter;
 
+// A piece of text with its own color, see fonsDrawTextSpans().
+struct FONStextSpan {
+	const char* str;
+	const char* end; // NULL for zero terminated strings.
+	unsigned int color;
+};
+typedef struct FONStextSpan FONStextSpan;
+
+// A glyph shaped by the caller, see fonsDrawGlyphs().
+struct FONSshapedGlyph {
+	int font;
+	int index;     // Glyph index in the font, not a codepoint.
+	float advance; // Distance to the next glyph in pixels.
+};
+typedef struct FONSshapedGlyph FONSshapedGlyph;
+
+// A row of text, see fonsTextBreakLines() and fonsLayoutParagraph().
+struct FONStextRow {
+	const char* start; // Start of the row in the text.
+	const char* end;   // End of the row, trailing spaces and the line break are not included.
+	const char* next;  // Start of the next row.
+	float width;       // Advance of the row.
+};
+typedef struct FONStextRow FONStextRow;
+
+struct FONSglyphPosition {
+	const char* str;  // Start of the glyph in the text.
+	float x;          // Pen position of the glyph.
+	float minx, maxx; // Horizontal bounds of the glyph quad.
+};
+typedef struct FONSglyphPosition FONSglyphPosition;
+
 // See also: stb_truetype documentation for stbtt_GetGlyphSDF. These parameters are copied from there
 struct FONSsdfSettings
 {
@@ -131,6 +234,29 @@ FONS_DEF int fonsAddFontSdfMem(FONScontext* s, const char* name, unsigned char*
 #endif
 
 FONS_DEF int fonsGetFontByName(FONScontext* s, const char* name);
+// The atlas value of an SDF font maps to the encoding of its FONSsdfSettings as 'value * scale + bias' (on the
+// 0..1 scale). The identity unless created with FONS_SDF_NORMALIZED.
+FONS_DEF void fonsGetSdfRemap(FONScontext* s, int font, float* scale, float* bias);
+// Rasterizes the glyphs of an SDF font at the given sizes only, the text is drawn from the smallest one that
+// holds the size on screen (see fonsSetTransformScale()) and scaled to the requested size. Larger sizes are
+// rasterized only when zoomed in. Returns 0 if the font is not an SDF font, there are too many sizes or the
+// context uses FONS_COMPACT_VERTICES (the scaled quads would be rounded to whole pixels).
+FONS_DEF int fonsSetSdfTiers(FONScontext* s, int font, const float* sizes, int nsizes);
+// Rasterizes the glyphs of the font only at sizes spaced evenly on a log scale, 'steps' sizes per doubling, and
+// scales them to the requested size. Animated sizes then reuse a few sizes instead of adding glyphs for each
+// tenth of a pixel. A size not drawn yet keeps the step of the nearest size drawn so far until it is
+// FONS_SIZE_HYSTERESIS steps past the halfway point, so that a size going back and forth does not flicker, and
+// then keeps its step. 0 rasterizes every size (the default), SDF tiers take precedence. Returns 0 if the context
+// uses FONS_COMPACT_VERTICES (the scaled quads would be rounded to whole pixels).
+FONS_DEF int fonsSetSizeSteps(FONScontext* s, int font, int steps);
+// Text of the SDF font that is smaller than 'size' pixels on screen (see fonsSetTransformScale()) is drawn from
+// the bitmaps of 'bitmapFont', a plain font added from the same data, rasterized at the size on screen in whole
+// pixels. Glyphs found in the fallback fonts are drawn from the bitmaps of a plain font added from the same data
+// as the fallback, or as SDF if there is none. FONS_HYBRID_BITMAP_TAG is added to the s texture coordinate of
+// the bitmap quads, so that one draw can mix both and the shader can tell them apart. FONS_INVALID turns it off.
+// Returns 0 if the fonts don't fit, or the context uses FONS_COMPACT_VERTICES (the scaled bitmap quads would be
+// rounded to whole pixels).
+FONS_DEF int fonsSetHybridFont(FONScontext* s, int font, int bitmapFont, float size);
 FONS_DEF int fonsAddFallbackFont(FONScontext* stash, int base, int fallback);
 
 // State handling
@@ -145,14 +271,86 @@ FONS_DEF void fonsSetSpacing(FONScontext* s, float spacing);
 FONS_DEF void fonsSetBlur(FONScontext* s, float blur);
 FONS_DEF void fonsSetAlign(FONScontext* s, int align);
 FONS_DEF void fonsSetFont(FONScontext* s, int font);
+// Text drawn between fonsBeginFrame() and fonsFlushFrame() is collected per batch key.
+FONS_DEF void fonsSetBatchKey(FONScontext* s, int key);
+// Glyphs outside the rect (in the same space as the text positions) are not drawn, nor rasterized. Lines that
+// are completely above or below it are skipped without measuring them, fonsDrawText() then returns 'x'.
+// Text appended to text buffers is not clipped.
+FONS_DEF void fonsSetClipRect(FONScontext* s, float x0, float y0, float x1, float y1);
+FONS_DEF void fonsResetClipRect(FONScontext* s);
+// Text smaller than 'size' (in the same units as fonsSetSize(), e.g. 2 pixels divided by the scale of the
+// transform) is drawn as in 'mode', from estimated word widths without looking up any glyphs.
+FONS_DEF void fonsSetGreeking(FONScontext* s, float size, int mode);
+// Size of a text unit in pixels under the transform the text is drawn with, picks the SDF tier to draw from.
+FONS_DEF void fonsSetTransformScale(FONScontext* s, float scale);
+// The size in pixels that text of the current font and size is rasterized at under the transform scale, e.g. the
+// SDF tier it is drawn from. Text buffers keep the quads of that size, lay them out again when it changes.
+FONS_DEF float fonsGetRasterSize(FONScontext* s);
+
+// Styles are snapshots of the state with the font, its scale and the vertical alignment already looked up, for
+// drawing many strings without setting the state for each. The transform scale and the batch key are still
+// taken from the current state. Returns FONS_INVALID if the font of the state is not valid.
+FONS_DEF int fonsCreateStyle(FONScontext* s);
+FONS_DEF void fonsDeleteStyle(FONScontext* s, int style);
 
 // Draw text
 FONS_DEF float fonsDrawText(FONScontext* s, float x, float y, const char* string, const char* end);
+// Like fonsDrawText() with the state of the style.
+FONS_DEF float fonsDrawTextStyled(FONScontext* s, int style, float x, float y, const char* string, const char* end);
+// Draws the spans one after another in their own colors, aligned as one string.
+FONS_DEF float fonsDrawTextSpans(FONScontext* s, float x, float y, const FONStextSpan* spans, int nspans);
+// Like fonsDrawText() but for text that is already decoded to UTF-32.
+FONS_DEF float fonsDrawCodepoints(FONScontext* s, float x, float y, const unsigned int* codepoints, int ncodepoints);
+// Draws glyphs that are already shaped, placed by their own advances without kerning or spacing. The glyphs
+// are cached by their index, and vertically aligned with the metrics of the current font.
+FONS_DEF float fonsDrawGlyphs(FONScontext* s, float x, float y, const FONSshapedGlyph* glyphs, int nglyphs);
+
+// Batching. After fonsBeginFrame() text is not drawn right away, but collected until fonsFlushFrame(), which
+// draws each batch key with one draw call, in increasing key order. 'beginBatch' is called before each batch
+// (e.g. to bind the shader for that key). Text buffers and fonsDrawDebug() are still drawn right away.
+FONS_DEF void fonsBeginFrame(FONScontext* s);
+FONS_DEF void fonsFlushFrame(FONScontext* s, void (*beginBatch)(void* uptr, int key), void* uptr);
+
+// Text buffers. Text appended to a buffer is laid out once (using the current state) and can then be drawn
+// any number of times without uploading the vertices again. Move the text using the shader transform.
+FONS_DEF int fonsCreateTextBuffer(FONScontext* s);
+FONS_DEF void fonsDeleteTextBuffer(FONScontext* s, int buffer);
+FONS_DEF void fonsClearTextBuffer(FONScontext* s, int buffer);
+FONS_DEF float fonsAppendText(FONScontext* s, int buffer, float x, float y, const char* string, const char* end);
+FONS_DEF void fonsDrawTextBuffer(FONScontext* s, int buffer);
+// Draws the text buffer once for each instance, scaled around the origin of the buffer and moved to (x, y).
+// The text is laid out (and its glyphs looked up) only once for all of the copies.
+FONS_DEF void fonsDrawTextBufferInstances(FONScontext* s, int buffer, const FONStextInstance* instances, int ninstances);
+
+// Line breaking. Text is broken after spaces, hyphens and CJK characters and at line breaks, a word longer than
+// the row is left on a row of its own. Returns the number of rows stored, continue from the 'next' of the last
+// row if all did not fit.
+FONS_DEF int fonsTextBreakLines(FONScontext* s, const char* string, const char* end, float breakRowWidth, FONStextRow* rows, int maxRows);
+// Glyph positions of a row, e.g. for hit testing and cursors.
+FONS_DEF int fonsTextGlyphPositions(FONScontext* s, float x, float y, const char* string, const char* end, FONSglyphPosition* positions, int maxPositions);
+
+// Paragraphs keep their rows, when the text or the width changes only the affected rows are broken again.
+// fonsLayoutParagraph() uses the current state, the rows stay valid until the next call.
+FONS_DEF int fonsCreateParagraph(FONScontext* s);
+FONS_DEF void fonsDeleteParagraph(FONScontext* s, int para);
+FONS_DEF int fonsLayoutParagraph(FONScontext* s, int para, const char* string, const char* end, float breakRowWidth, const FONStextRow** rows);
+// Draws the rows laid out by fonsLayoutParagraph(), returns the y below the last row.
+FONS_DEF float fonsDrawParagraph(FONScontext* s, int para, float x, float y, float lineHeight);
 
 // Measure text
+// Measuring text uses the glyph metrics only, it does not add the glyphs to the atlas.
 FONS_DEF float fonsTextBounds(FONScontext* s, float x, float y, const char* string, const char* end, float* bounds);
+// Measures many strings in the current style at once. 'ends' can be NULL if all strings are zero terminated.
+// The advances are written to 'advances', and the bounds of the strings at the origin to 'bounds' (4 floats
+// per string) if it is not NULL.
+FONS_DEF void fonsTextBoundsMany(FONScontext* s, const char* const* strings, const char* const* ends, int nstrings,
+								 float* advances, float* bounds);
 FONS_DEF void fonsLineBounds(FONScontext* s, float y, float* miny, float* maxy);
 FONS_DEF void fonsVertMetrics(FONScontext* s, float* ascender, float* descender, float* lineh);
+// Like fonsTextBounds() and fonsVertMetrics() in the style.
+FONS_DEF float fonsTextBoundsStyled(FONScontext* s, int style, float x, float y, const char* string, const char* end,
+									float* bounds);
+FONS_DEF void fonsVertMetricsStyled(FONScontext* s, int style, float* ascender, float* descender, float* lineh);
 
 // Text iterator
 FONS_DEF int fonsTextIterInit(FONScontext* stash, FONStextIter* iter, float x, float y, const char* str, const char* end);
@@ -176,6 +374,12 @@ FONS_DEF void fonsDrawDebug(FONScontext* s, float x, float y);
 
 #define FONS_NOTUSED(v)  (void)sizeof(v)
 
+// SSE2 is used to find and convert blocks of ASCII text, define FONS_NO_SIMD to disable.
+#if !defined(FONS_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#	define FONS__SSE2 1
+#	include <emmintrin.h>
+#endif
+
 #ifdef FONS_USE_FREETYPE
 
 #include <ft2build.h>
@@ -208,6 +412,11 @@ static int fons__tt_loadFont(FONScontext *context, FONSttFontImpl *font, unsigne
 	return ftError == 0;
 }
 
+static void fons__tt_freeFont(FONSttFontImpl *font)
+{
+	FONS_NOTUSED(font);
+}
+
 static void fons__tt_getFontVMetrics(FONSttFontImpl *font, int *ascent, int *descent, int *lineGap)
 {
 	*ascent = font->font->ascender;
@@ -236,36 +445,46 @@ static int fons__tt_buildGlyphBitmap(FONSttFontImpl *font, int glyph, float size
 
 	ftError = FT_Set_Pixel_Sizes(font->font, 0, (FT_UInt)(size * (float)font->font->units_per_EM / (float)(font->font->ascender - font->font->descender)));
 	if (ftError) return 0;
-	ftError = FT_Load_Glyph(font->font, glyph, FT_LOAD_RENDER);
+	// Only load the outline, measuring does not need the bitmap. The box is the one the renderer covers.
+	ftError = FT_Load_Glyph(font->font, glyph, FT_LOAD_DEFAULT);
 	if (ftError) return 0;
 	ftError = FT_Get_Advance(font->font, glyph, FT_LOAD_NO_SCALE, &advFixed);
 	if (ftError) return 0;
 	ftGlyph = font->font->glyph;
 	*advance = (int)advFixed;
 	*lsb = (int)ftGlyph->metrics.horiBearingX;
-	*x0 = ftGlyph->bitmap_left;
-	*x1 = *x0 + ftGlyph->bitmap.width;
-	*y0 = -ftGlyph->bitmap_top;
-	*y1 = *y0 + ftGlyph->bitmap.rows;
+	if (ftGlyph->format == FT_GLYPH_FORMAT_BITMAP) {
+		*x0 = ftGlyph->bitmap_left;
+		*x1 = *x0 + ftGlyph->bitmap.width;
+		*y0 = -ftGlyph->bitmap_top;
+		*y1 = *y0 + ftGlyph->bitmap.rows;
+	} else {
+		*x0 = (int)(ftGlyph->metrics.horiBearingX >> 6);
+		*x1 = (int)((ftGlyph->metrics.horiBearingX + ftGlyph->metrics.width + 63) >> 6);
+		*y0 = -(int)((ftGlyph->metrics.horiBearingY + 63) >> 6);
+		*y1 = -(int)((ftGlyph->metrics.horiBearingY - ftGlyph->metrics.height) >> 6);
+	}
 	return 1;
 }
 
 static void fons__tt_renderGlyphBitmap(FONSttFontImpl *font, unsigned char *output, int outWidth, int outHeight, int outStride,
 								float scaleX, float scaleY, int glyph, const FONSsdfSettings* sdfSettings)
 {
-	FT_GlyphSlot ftGlyph = font->font->glyph;
-	int ftGlyphOffset = 0;
-	int x, y;
-	FONS_NOTUSED(outWidth);
-	FONS_NOTUSED(outHeight);
+	FT_GlyphSlot ftGlyph;
+	int x, y, w, h;
 	FONS_NOTUSED(scaleX);
-	FONS_NOTUSED(scaleY);
-	FONS_NOTUSED(glyph);	// glyph has already been loaded by fons__tt_buildGlyphBitmap
 	FONS_NOTUSED(sdfSettings);
 
-	for ( y = 0; y < ftGlyph->bitmap.rows; y++ ) {
-		for ( x = 0; x < ftGlyph->bitmap.width; x++ ) {
-			output[(y * outStride) + x] = ftGlyph->bitmap.buffer[ftGlyphOffset++];
+	// The glyph may have been measured long before, load and render it at the size of the scale.
+	if (FT_Set_Pixel_Sizes(font->font, 0, (FT_UInt)(scaleY * (float)font->font->units_per_EM))) return;
+	if (FT_Load_Glyph(font->font, glyph, FT_LOAD_RENDER)) return;
+	ftGlyph = font->font->glyph;
+	w = (int)ftGlyph->bitmap.width < outWidth ? (int)ftGlyph->bitmap.width : outWidth;
+	h = (int)ftGlyph->bitmap.rows < outHeight ? (int)ftGlyph->bitmap.rows : outHeight;
+
+	for ( y = 0; y < h; y++ ) {
+		for ( x = 0; x < w; x++ ) {
+			output[(y * outStride) + x] = ftGlyph->bitmap.buffer[y * ftGlyph->bitmap.pitch + x];
 		}
 	}
 }
@@ -287,8 +506,22 @@ static void fons__tmpfree(void* ptr, void* up);
 #define STBTT_free(x,u)      fons__tmpfree(x,u)
 #include "stb_truetype.h"
 
+// Number of decoded glyph outlines kept per face (must be a power of two).
+#ifndef FONS_OUTLINE_CACHE_SIZE
+#	define FONS_OUTLINE_CACHE_SIZE 256
+#endif
+
+// Outline of a glyph, shared by all sizes and SDF settings of the face.
+struct FONSoutline {
+	int glyph;
+	int nverts;
+	stbtt_vertex* verts;
+};
+typedef struct FONSoutline FONSoutline;
+
 struct FONSttFontImpl {
 	stbtt_fontinfo font;
+	FONSoutline outlines[FONS_OUTLINE_CACHE_SIZE];
 };
 typedef struct FONSttFontImpl FONSttFontImpl;
 
@@ -300,14 +533,23 @@ static int fons__tt_init(FONScontext *context)
 
 static int fons__tt_loadFont(FONScontext *context, FONSttFontImpl *font, unsigned char *data, int dataSize)
 {
-	int stbError;
+	int stbError, i;
 	FONS_NOTUSED(dataSize);
 
 	font->font.userdata = context;
 	stbError = stbtt_InitFont(&font->font, data, 0);
+	for (i = 0; i < FONS_OUTLINE_CACHE_SIZE; i++)
+		font->outlines[i].glyph = -1;
 	return stbError;
 }
 
+static void fons__tt_freeFont(FONSttFontImpl *font)
+{
+	int i;
+	for (i = 0; i < FONS_OUTLINE_CACHE_SIZE; i++)
+		free(font->outlines[i].verts);
+}
+
 static void fons__tt_getFontVMetrics(FONSttFontImpl *font, int *ascent, int *descent, int *lineGap)
 {
 	stbtt_GetFontVMetrics(&font->font, ascent, descent, lineGap);
@@ -341,17 +583,61 @@ static int fons__tt_buildGlyphBitmap(FONSttFontImpl *font, int glyph, float size
 	return 1;
 }
 
+// Returns the outline of the glyph, decoding it only if it is not cached.
+static stbtt_vertex* fons__tt_getOutline(FONSttFontImpl *font, int glyph, int *nverts)
+{
+	FONSoutline* outline = &font->outlines[glyph & (FONS_OUTLINE_CACHE_SIZE-1)];
+	stbtt_vertex* verts;
+	int n;
+
+	if (outline->glyph == glyph) {
+		*nverts = outline->nverts;
+		return outline->verts;
+	}
+
+	// Decoded into the scratch buffer, kept in a copy.
+	n = stbtt_GetGlyphShape(&font->font, glyph, &verts);
+	free(outline->verts);
+	outline->glyph = -1;
+	outline->nverts = 0;
+	outline->verts = NULL;
+	if (n > 0 && verts != NULL) {
+		outline->verts = (stbtt_vertex*)malloc(sizeof(stbtt_vertex) * n);
+		if (outline->verts == NULL) {
+			*nverts = n;
+			return verts;
+		}
+		memcpy(outline->verts, verts, sizeof(stbtt_vertex) * n);
+		outline->nverts = n;
+	}
+	outline->glyph = glyph;
+	*nverts = outline->nverts;
+	return outline->verts;
+}
+
 static void fons__tt_renderGlyphBitmap(FONSttFontImpl *font, unsigned char *output, int outWidth, int outHeight, int outStride,
 								float scaleX, float scaleY, int glyph, const FONSsdfSettings* sdfSettings)
 {
+	int nverts;
+	stbtt_vertex* verts = fons__tt_getOutline(font, glyph, &nverts);
+
 	if (!sdfSettings->sdfEnabled)
 	{
-		stbtt_MakeGlyphBitmap(&font->font, output, outWidth, outHeight, outStride, scaleX, scaleY, glyph);
+		// Same as stbtt_MakeGlyphBitmap() but from the cached outline.
+		int ix0, iy0;
+		stbtt__bitmap gbm;
+		stbtt_GetGlyphBitmapBoxSubpixel(&font->font, glyph, scaleX, scaleY, 0.0f, 0.0f, &ix0, &iy0, 0, 0);
+		gbm.pixels = output;
+		gbm.w = outWidth;
+		gbm.h = outHeight;
+		gbm.stride = outStride;
+		if (gbm.w && gbm.h)
+			stbtt_Rasterize(&gbm, 0.35f, verts, nverts, scaleX, scaleY, 0.0f, 0.0f, ix0, iy0, 1, font->font.userdata);
 	}
 	else
 	{
 		int w = 0, h = 0, xoff = 0, yoff = 0;
-		unsigned char* sdfData = stbtt_GetGlyphSDF(&font->font, scaleX, glyph, sdfSettings->padding, sdfSettings->onedgeValue, sdfSettings->pixelDistScale, &w, &h, &xoff, &yoff);
+		unsigned char* sdfData = stbtt_GetGlyphShapeSDF(&font->font, scaleX, glyph, verts, nverts, sdfSettings->padding, sdfSettings->onedgeValue, sdfSettings->pixelDistScale, &w, &h, &xoff, &yoff);
 
 		for (int y = 0; y < h; y++)
 		{
@@ -388,15 +674,74 @@ static int fons__tt_getGlyphKernAdvance(FONSttFontImpl *font, int glyph1, int gl
 #ifndef FONS_INIT_ATLAS_NODES
 #	define FONS_INIT_ATLAS_NODES 256
 #endif
+// Initial size of the vertex arena, it grows up to FONS_MAX_VERTEX_COUNT before drawing is split into
+// several draw calls.
 #ifndef FONS_VERTEX_COUNT
 #	define FONS_VERTEX_COUNT 1024
 #endif
+#ifndef FONS_MAX_VERTEX_COUNT
+#	define FONS_MAX_VERTEX_COUNT (1024*256)
+#endif
+#ifndef FONS_INSTANCE_COUNT
+#	define FONS_INSTANCE_COUNT 1024
+#endif
 #ifndef FONS_MAX_STATES
 #	define FONS_MAX_STATES 20
 #endif
 #ifndef FONS_MAX_FALLBACKS
 #	define FONS_MAX_FALLBACKS 20
 #endif
+#ifndef FONS_MAX_SDF_TIERS
+#	define FONS_MAX_SDF_TIERS 4
+#endif
+// How much an SDF tier may be magnified on screen before the next larger tier is used.
+#ifndef FONS_SDF_TIER_MAGNIFY
+#	define FONS_SDF_TIER_MAGNIFY 2.0f
+#endif
+// How far past the halfway point between two size steps (in steps) a size must go before switching.
+#ifndef FONS_SIZE_HYSTERESIS
+#	define FONS_SIZE_HYSTERESIS 0.25f
+#endif
+// Number of sizes per font whose size step is remembered.
+#ifndef FONS_SIZE_STEP_CACHE_SIZE
+#	define FONS_SIZE_STEP_CACHE_SIZE 32
+#endif
+// Number of laid out strings kept for reuse by fonsDrawText (must be a power of two).
+#ifndef FONS_RUN_CACHE_SIZE
+#	define FONS_RUN_CACHE_SIZE 64
+#endif
+// Longer strings than this (in bytes) are not cached.
+#ifndef FONS_RUN_MAX_BYTES
+#	define FONS_RUN_MAX_BYTES 256
+#endif
+// Number of codepoints decoded at a time.
+#ifndef FONS_DECODE_CHUNK
+#	define FONS_DECODE_CHUNK 64
+#endif
+// Number of word advances kept for line breaking (must be a power of two).
+#ifndef FONS_WORD_CACHE_SIZE
+#	define FONS_WORD_CACHE_SIZE 512
+#endif
+// Longer words than this (in bytes) are measured every time.
+#ifndef FONS_WORD_MAX_BYTES
+#	define FONS_WORD_MAX_BYTES 24
+#endif
+// Number of codepoints per font whose font and glyph index are remembered (must be a power of two).
+#ifndef FONS_CMAP_CACHE_SIZE
+#	define FONS_CMAP_CACHE_SIZE 256
+#endif
+// Number of kerning pairs remembered per font face (must be a power of two).
+#ifndef FONS_KERN_CACHE_SIZE
+#	define FONS_KERN_CACHE_SIZE 512
+#endif
+// Padding of the glyphs of SDF fonts with FONS_SDF_NORMALIZED. Fonts with more padding are rasterized apart.
+#ifndef FONS_SDF_PADDING
+#	define FONS_SDF_PADDING 10
+#endif
+// Number of measured glyphs kept per font, the cache is cleared when it fills up.
+#ifndef FONS_METRICS_CACHE_SIZE
+#	define FONS_METRICS_CACHE_SIZE 4096
+#endif
 
 static unsigned int fons__hashint(unsigned int a)
 {
@@ -425,28 +770,84 @@ struct FONSglyph
 	int index;
 	int next;
 	short size, blur;
+	short rsize; // Size of the bitmap, differs from 'size' when drawn scaled (SDF tiers, size steps).
+	short sdf;   // Rasterized as a signed distance field.
+	short bitmap; // Looked up as small text of a hybrid font, see fons__hybridBitmap().
 	short x0,y0,x1,y1;
 	short xadv,xoff,yoff;
 };
 typedef struct FONSglyph FONSglyph;
 
-struct FONSfont
+// A codepoint resolved to the font that draws it, the font itself or one of its fallbacks.
+struct FONScmapEntry
+{
+	unsigned int codepoint;
+	struct FONSfont* font;
+	int index;
+};
+typedef struct FONScmapEntry FONScmapEntry;
+
+struct FONSkernEntry
+{
+	unsigned int pair; // Glyph indices, first one in the high bits.
+	int advance;       // In font units.
+};
+typedef struct FONSkernEntry FONSkernEntry;
+
+// A size drawn with a font that has size steps, and the step it is rasterized at.
+struct FONSsizeStep
+{
+	short size, rsize;
+};
+typedef struct FONSsizeStep FONSsizeStep;
+
+// The parsed font data. Fonts added from the same data share one face and differ only in how their glyphs
+// are rendered.
+struct FONSface
 {
 	FONSttFontImpl font;
-	char name[64];
 	unsigned char* data;
 	int dataSize;
 	unsigned char freeData;
 	float ascender;
 	float descender;
 	float lineh;
+	// Average advance of a character relative to the size, for greeking.
+	float greekAdvance;
+	// One bit per BMP codepoint that has a glyph in the face, built when a font of it is added as a fallback.
+	unsigned char* coverage;
+	FONSkernEntry kerns[FONS_KERN_CACHE_SIZE];
+};
+typedef struct FONSface FONSface;
+
+struct FONSfont
+{
+	FONSface* face;
+	char name[64];
 	FONSglyph* glyphs;
 	int cglyphs;
 	int nglyphs;
 	int lut[FONS_HASH_LUT_SIZE];
+	// Glyphs that have been measured but not rasterized, kept apart from the atlas.
+	FONSglyph* metrics;
+	int cmetrics;
+	int nmetrics;
+	int metricsLut[FONS_HASH_LUT_SIZE];
 	int fallbacks[FONS_MAX_FALLBACKS];
 	int nfallbacks;
-	FONSsdfSettings sdfSettings;
+	FONScmapEntry cmap[FONS_CMAP_CACHE_SIZE];
+	FONSsdfSettings sdfSettings; // How the glyphs are rasterized.
+	FONSsdfSettings drawSdfSettings; // As the font was added, differs from sdfSettings with FONS_SDF_NORMALIZED.
+	// The first font added with the same face and sdfSettings. It keeps the rasterized glyphs of all of them by
+	// glyph index, the glyph caches of the fonts point to the same atlas rects.
+	struct FONSfont* raster;
+	short tiers[FONS_MAX_SDF_TIERS]; // Ascending sizes, times 10 like the glyph sizes.
+	int ntiers;
+	int sizeSteps;
+	FONSsizeStep snapped[FONS_SIZE_STEP_CACHE_SIZE]; // Sizes drawn so far, the oldest one is replaced when full.
+	int nsnapped, nextSnapped;
+	int bitmapFont; // Draws small text of a hybrid font, see fonsSetHybridFont().
+	float bitmapSize;
 };
 typedef struct FONSfont FONSfont;
 
@@ -458,9 +859,122 @@ struct FONSstate
 	unsigned int color;
 	float blur;
 	float spacing;
+	int batchKey;
+	int clipping;
+	float clip[4]; // minx, miny, maxx, maxy
+	int greekMode;
+	float greekSize;
+	float transformScale;
 };
 typedef struct FONSstate FONSstate;
 
+// A state with its font resolved, see fonsCreateStyle(). fonsDrawText() resolves the current state each call.
+struct FONSstyle
+{
+	FONSstate state;
+	FONSfont* font;
+	short isize, iblur;
+	float scale; // Pixel height scale of the font at the size.
+	float dy;    // Vertical alignment offset.
+};
+typedef struct FONSstyle FONSstyle;
+
+// Text collected for one batch key during a frame.
+struct FONSbatch
+{
+	int key;
+	FONSvertex* verts;
+	int nverts;
+	int cverts;
+	FONSinstance* insts;
+	int ninsts;
+	int cinsts;
+};
+typedef struct FONSbatch FONSbatch;
+
+// A laid out string. Quads are relative to the pen origin and already aligned,
+// so drawing the same string again only needs to offset and snap them.
+struct FONSrun
+{
+	unsigned int hash;
+	int font;
+	int align;
+	short isize, iblur;
+	short rsize;
+	short bitmap;
+	float spacing;
+	int generation;
+	unsigned int lastUsed;
+	char* str;
+	int nstr;
+	FONSquad* quads;
+	int nquads;
+	int cquads;
+	float dx, dy;
+	float advance;
+};
+typedef struct FONSrun FONSrun;
+
+struct FONStextBufferItem
+{
+	FONSstate state;
+	float x, y;
+	int str, nstr;
+};
+typedef struct FONStextBufferItem FONStextBufferItem;
+
+struct FONStextBuffer
+{
+	FONSvertex* verts;
+	int nverts;
+	int cverts;
+	// The appended strings are kept to be able to lay the text out again if the atlas changes.
+	char* text;
+	int ntext;
+	int ctext;
+	FONStextBufferItem* items;
+	int nitems;
+	int citems;
+	int generation;
+	int dirty;
+};
+typedef struct FONStextBuffer FONStextBuffer;
+
+// Advance of a word (or the spaces after it) for line breaking.
+struct FONSword
+{
+	unsigned int hash;
+	int font;
+	short isize;
+	float spacing;
+	float advance;
+	int nstr;
+	char str[FONS_WORD_MAX_BYTES];
+};
+typedef struct FONSword FONSword;
+
+struct FONSparagraph
+{
+	// The text is double buffered, so that the rows of the previous layout can be compared and reused.
+	char* text[2];
+	int ctext[2];
+	int cur;
+	int ntext;
+	FONStextRow* rows;
+	int nrows;
+	int crows;
+	// Rows broken again during a layout.
+	FONStextRow* scratch;
+	int cscratch;
+	// Style and width the rows were laid out with.
+	int valid;
+	int font;
+	short isize;
+	float spacing;
+	float breakRowWidth;
+};
+typedef struct FONSparagraph FONSparagraph;
+
 struct FONSatlasNode {
 	short x, y, width;
 };
@@ -485,14 +999,40 @@ struct FONScontext
 	FONSatlas* atlas;
 	int cfonts;
 	int nfonts;
-	float verts[FONS_VERTEX_COUNT*2];
-	float tcoords[FONS_VERTEX_COUNT*2];
-	unsigned int colors[FONS_VERTEX_COUNT];
+	FONSface** faces;
+	int cfaces;
+	int nfaces;
+	// Points to either the arena or memory given by renderMapVertices, NULL when nothing is being written.
+	FONSvertex* verts;
 	int nverts;
+	int cverts;
+	FONSvertex* arena;
+	int carena;
+	FONSinstance* insts;
+	int ninsts;
+	int cinsts;
 	unsigned char* scratch;
 	int nscratch;
 	FONSstate states[FONS_MAX_STATES];
 	int nstates;
+	FONSrun runs[FONS_RUN_CACHE_SIZE];
+	FONSrun layout; // Scratch run for aligning strings that are not cached.
+	unsigned int runCounter;
+	int atlasGeneration;
+	FONStextBuffer** textBuffers;
+	int ntextBuffers;
+	FONStextBuffer* capture;
+	FONSparagraph** paragraphs;
+	int nparagraphs;
+	FONSstyle** styles;
+	int nstyles;
+	FONSword words[FONS_WORD_CACHE_SIZE];
+	// Sorted by key.
+	FONSbatch* batches;
+	int nbatches;
+	int cbatches;
+	FONSbatch* batch; // Last used batch.
+	int batching;
 	void (*handleError)(void* uptr, int error, int val);
 	void* errorUptr;
 };
@@ -565,6 +1105,49 @@ static unsigned int fons__decutf8(unsigned int* state, unsigned int* codep, unsi
 	return *state;
 }
 
+// Decodes up to 'maxcps' codepoints from 'str' to 'cps' and advances 'str' past them. ASCII is copied as is
+// without going through the DFA, 16 bytes at a time when SSE2 is available.
+static int fons__decodeUtf8(unsigned int* state, unsigned int* codep, const char** str, const char* end,
+							unsigned int* cps, int maxcps)
+{
+	const unsigned char* s = (const unsigned char*)*str;
+	const unsigned char* e = (const unsigned char*)end;
+	int n = 0;
+
+	while (s != e && n < maxcps) {
+		if (*state == FONS_UTF8_ACCEPT) {
+#ifdef FONS__SSE2
+			while (maxcps - n >= 16 && e - s >= 16) {
+				__m128i zero = _mm_setzero_si128();
+				__m128i bytes = _mm_loadu_si128((const __m128i*)s);
+				__m128i lo, hi;
+				if (_mm_movemask_epi8(bytes) != 0)
+					break;
+				lo = _mm_unpacklo_epi8(bytes, zero);
+				hi = _mm_unpackhi_epi8(bytes, zero);
+				_mm_storeu_si128((__m128i*)&cps[n+0], _mm_unpacklo_epi16(lo, zero));
+				_mm_storeu_si128((__m128i*)&cps[n+4], _mm_unpackhi_epi16(lo, zero));
+				_mm_storeu_si128((__m128i*)&cps[n+8], _mm_unpacklo_epi16(hi, zero));
+				_mm_storeu_si128((__m128i*)&cps[n+12], _mm_unpackhi_epi16(hi, zero));
+				s += 16;
+				n += 16;
+			}
+			if (s == e || n == maxcps)
+				break;
+#endif
+			if (*s < 0x80) {
+				cps[n++] = *s++;
+				continue;
+			}
+		}
+		if (fons__decutf8(state, codep, *s++) == FONS_UTF8_ACCEPT)
+			cps[n++] = *codep;
+	}
+
+	*str = (const char*)s;
+	return n;
+}
+
 // Atlas based on Skyline Bin Packer by Jukka Jylänki
 
 static void fons__deleteAtlas(FONSatlas* atlas)
@@ -783,6 +1366,14 @@ FONScontext* fonsCreateInternal(FONSparams* params)
 	stash->scratch = (unsigned char*)malloc(FONS_SCRATCH_BUF_SIZE);
 	if (stash->scratch == NULL) goto error;
 
+	// Allocate vertex and instance staging.
+	stash->arena = (FONSvertex*)malloc(sizeof(FONSvertex) * FONS_VERTEX_COUNT);
+	if (stash->arena == NULL) goto error;
+	stash->carena = FONS_VERTEX_COUNT;
+	stash->insts = (FONSinstance*)malloc(sizeof(FONSinstance) * FONS_INSTANCE_COUNT);
+	if (stash->insts == NULL) goto error;
+	stash->cinsts = FONS_INSTANCE_COUNT;
+
 	// Initialize implementation library
 	if (!fons__tt_init(stash)) goto error;
 
@@ -831,11 +1422,43 @@ static FONSstate* fons__getState(FONScontext* stash)
 	return &stash->states[stash->nstates-1];
 }
 
+static void fons__buildCoverage(FONSface* face)
+{
+	unsigned int c;
+
+	if (face->coverage != NULL) return;
+	face->coverage = (unsigned char*)calloc(0x10000 / 8, 1);
+	if (face->coverage == NULL) return;
+	for (c = 0; c < 0x10000; c++) {
+		if (c >= 0xd800 && c <= 0xdfff) continue; // Surrogates
+		if (fons__tt_getGlyphIndex(&face->font, c) != 0)
+			face->coverage[c >> 3] |= (unsigned char)(1 << (c & 7));
+	}
+}
+
+// Returns 0 if the face surely has no glyph for the codepoint.
+static int fons__mayCover(FONSface* face, unsigned int codepoint)
+{
+	if (face->coverage == NULL || codepoint >= 0x10000) return 1;
+	return (face->coverage[codepoint >> 3] >> (codepoint & 7)) & 1;
+}
+
 int fonsAddFallbackFont(FONScontext* stash, int base, int fallback)
 {
 	FONSfont* baseFont = stash->fonts[base];
+	int i;
 	if (baseFont->nfallbacks < FONS_MAX_FALLBACKS) {
+		fons__buildCoverage(stash->fonts[fallback]->face);
 		baseFont->fallbacks[baseFont->nfallbacks++] = fallback;
+		// Missing codepoints may be found in the new fallback.
+		for (i = 0; i < FONS_CMAP_CACHE_SIZE; i++)
+			baseFont->cmap[i].codepoint = 0xffffffff;
+		// So may the metrics measured for them.
+		baseFont->nmetrics = 0;
+		for (i = 0; i < FONS_HASH_LUT_SIZE; i++)
+			baseFont->metricsLut[i] = -1;
+		// Words may have been measured with missing glyphs.
+		memset(stash->words, 0, sizeof(stash->words));
 		return 1;
 	}
 	return 0;
@@ -871,6 +1494,38 @@ void fonsSetFont(FONScontext* stash, int font)
 	fons__getState(stash)->font = font;
 }
 
+void fonsSetBatchKey(FONScontext* stash, int key)
+{
+	fons__getState(stash)->batchKey = key;
+}
+
+void fonsSetClipRect(FONScontext* stash, float x0, float y0, float x1, float y1)
+{
+	FONSstate* state = fons__getState(stash);
+	state->clipping = 1;
+	state->clip[0] = x0 < x1 ? x0 : x1;
+	state->clip[1] = y0 < y1 ? y0 : y1;
+	state->clip[2] = x0 < x1 ? x1 : x0;
+	state->clip[3] = y0 < y1 ? y1 : y0;
+}
+
+void fonsResetClipRect(FONScontext* stash)
+{
+	fons__getState(stash)->clipping = 0;
+}
+
+void fonsSetGreeking(FONScontext* stash, float size, int mode)
+{
+	FONSstate* state = fons__getState(stash);
+	state->greekSize = size;
+	state->greekMode = mode;
+}
+
+void fonsSetTransformScale(FONScontext* stash, float scale)
+{
+	fons__getState(stash)->transformScale = scale;
+}
+
 void fonsPushState(FONScontext* stash)
 {
 	if (stash->nstates >= FONS_MAX_STATES) {
@@ -902,16 +1557,30 @@ void fonsClearState(FONScontext* stash)
 	state->blur = 0;
 	state->spacing = 0;
 	state->align = FONS_ALIGN_LEFT | FONS_ALIGN_BASELINE;
+	state->batchKey = 0;
+	state->clipping = 0;
+	state->greekMode = FONS_GREEK_NONE;
+	state->greekSize = 0.0f;
+	state->transformScale = 1.0f;
 }
 
 static void fons__freeFont(FONSfont* font)
 {
 	if (font == NULL) return;
 	if (font->glyphs) free(font->glyphs);
-	if (font->freeData && font->data) free(font->data);
+	if (font->metrics) free(font->metrics);
 	free(font);
 }
 
+static void fons__freeFace(FONSface* face)
+{
+	if (face == NULL) return;
+	fons__tt_freeFont(&face->font);
+	if (face->coverage) free(face->coverage);
+	if (face->freeData && face->data) free(face->data);
+	free(face);
+}
+
 static int fons__allocFont(FONScontext* stash)
 {
 	FONSfont* font = NULL;
@@ -1014,9 +1683,89 @@ int fonsAddFontMem(FONScontext* stash, const char* name, unsigned char* data, in
 }
 
 
+// Returns the face of the font data, parsing it only if no other font has been added from the same data.
+static FONSface* fons__getFace(FONScontext* stash, unsigned char* data, int dataSize, int freeData)
+{
+	int i, ascent, descent, fh, lineGap, glyph, advance, lsb, x0, y0, x1, y1, n = 0, total = 0;
+	const char* common = "etaoinshrdlu";
+	FONSsdfSettings noSdf;
+	FONSface* face;
+
+	for (i = 0; i < stash->nfaces; i++) {
+		face = stash->faces[i];
+		if (face->data == data) {
+			face->freeData |= (unsigned char)freeData;
+			return face;
+		}
+		// E.g. the same file loaded by fonsAddFontSdf() for each render setting.
+		if (face->dataSize == dataSize && memcmp(face->data, data, dataSize) == 0) {
+			if (freeData) free(data);
+			return face;
+		}
+	}
+
+	if (stash->nfaces+1 > stash->cfaces) {
+		FONSface** faces;
+		int cfaces = stash->cfaces == 0 ? 4 : stash->cfaces * 2;
+		faces = (FONSface**)realloc(stash->faces, sizeof(FONSface*) * cfaces);
+		if (faces == NULL) goto error;
+		stash->faces = faces;
+		stash->cfaces = cfaces;
+	}
+	face = (FONSface*)calloc(1, sizeof(FONSface));
+	if (face == NULL) goto error;
+	for (i = 0; i < FONS_KERN_CACHE_SIZE; ++i)
+		face->kerns[i].pair = 0xffffffff;
+
+	// Read in the font data.
+	face->dataSize = dataSize;
+	face->data = data;
+	face->freeData = (unsigned char)freeData;
+
+	// Init font
+	stash->nscratch = 0;
+	if (!fons__tt_loadFont(stash, &face->font, data, dataSize)) {
+		fons__freeFace(face);
+		return NULL;
+	}
+
+	// Store normalized line height. The real line height is got
+	// by multiplying the lineh by font size.
+	fons__tt_getFontVMetrics( &face->font, &ascent, &descent, &lineGap);
+	fh = ascent - descent;
+	face->ascender = (float)ascent / (float)fh;
+	face->descender = (float)descent / (float)fh;
+	face->lineh = (float)(fh + lineGap) / (float)fh;
+
+	// Average advance of the most common letters, for greeking.
+	memset(&noSdf, 0, sizeof(noSdf));
+	for (i = 0; common[i] != '\0'; i++) {
+		glyph = fons__tt_getGlyphIndex(&face->font, common[i]);
+		if (glyph != 0 && fons__tt_buildGlyphBitmap(&face->font, glyph, 10.0f, fons__tt_getPixelHeightScale(&face->font, 10.0f), &advance, &lsb, &x0, &y0, &x1, &y1, &noSdf)) {
+			total += advance;
+			n++;
+		}
+	}
+	face->greekAdvance = n > 0 ? (float)total / (float)(n * fh) : 0.5f;
+
+	stash->faces[stash->nfaces++] = face;
+	return face;
+
+error:
+	if (freeData) free(data);
+	return NULL;
+}
+
+static int fons__sameSdfSettings(const FONSsdfSettings* a, const FONSsdfSettings* b)
+{
+	if (!a->sdfEnabled || !b->sdfEnabled)
+		return a->sdfEnabled == b->sdfEnabled;
+	return a->onedgeValue == b->onedgeValue && a->padding == b->padding && a->pixelDistScale == b->pixelDistScale;
+}
+
 int fonsAddFontSdfMem(FONScontext* stash, const char* name, unsigned char* data, int dataSize, int freeData, FONSsdfSettings sdfSettings)
 {
-	int i, ascent, descent, fh, lineGap;
+	int i;
 	FONSfont* font;
 
 	int idx = fons__allocFont(stash);
@@ -1025,30 +1774,37 @@ int fonsAddFontSdfMem(FONScontext* stash, const char* name, unsigned char* data,
 
 	font = stash->fonts[idx];
 	font->sdfSettings = sdfSettings;
+	font->drawSdfSettings = sdfSettings;
+	// The distance is stored so that the whole padding fits in the 0..255 range.
+	if (sdfSettings.sdfEnabled && (stash->params.flags & FONS_SDF_NORMALIZED)) {
+		font->sdfSettings.onedgeValue = 127;
+		font->sdfSettings.padding = fons__maxi(sdfSettings.padding, FONS_SDF_PADDING);
+		font->sdfSettings.pixelDistScale = 127.0f / (float)font->sdfSettings.padding;
+	}
 
 	strncpy(font->name, name, sizeof(font->name));
 	font->name[sizeof(font->name)-1] = '\0';
 
 	// Init hash lookup.
-	for (i = 0; i < FONS_HASH_LUT_SIZE; ++i)
+	for (i = 0; i < FONS_HASH_LUT_SIZE; ++i) {
 		font->lut[i] = -1;
-
-	// Read in the font data.
-	font->dataSize = dataSize;
-	font->data = data;
-	font->freeData = (unsigned char)freeData;
-
-	// Init font
-	stash->nscratch = 0;
-	if (!fons__tt_loadFont(stash, &font->font, data, dataSize)) goto error;
-
-	// Store normalized line height. The real line height is got
-	// by multiplying the lineh by font size.
-	fons__tt_getFontVMetrics( &font->font, &ascent, &descent, &lineGap);
-	fh = ascent - descent;
-	font->ascender = (float)ascent / (float)fh;
-	font->descender = (float)descent / (float)fh;
-	font->lineh = (float)(fh + lineGap) / (float)fh;
+		font->metricsLut[i] = -1;
+	}
+	for (i = 0; i < FONS_CMAP_CACHE_SIZE; ++i)
+		font->cmap[i].codepoint = 0xffffffff;
+
+	font->face = fons__getFace(stash, data, dataSize, freeData);
+	if (font->face == NULL) goto error;
+
+	font->raster = font;
+	font->bitmapFont = FONS_INVALID;
+	for (i = 0; i < idx; i++) {
+		FONSfont* other = stash->fonts[i];
+		if (other->face == font->face && fons__sameSdfSettings(&other->sdfSettings, &font->sdfSettings)) {
+			font->raster = other->raster;
+			break;
+		}
+	}
 
 	return idx;
 
@@ -1058,6 +1814,75 @@ error:
 	return FONS_INVALID;
 }
 
+void fonsGetSdfRemap(FONScontext* stash, int font, float* scale, float* bias)
+{
+	const FONSsdfSettings* atlas;
+	const FONSsdfSettings* draw;
+
+	*scale = 1.0f;
+	*bias = 0.0f;
+	if (stash == NULL || font < 0 || font >= stash->nfonts) return;
+	atlas = &stash->fonts[font]->sdfSettings;
+	draw = &stash->fonts[font]->drawSdfSettings;
+	if (!atlas->sdfEnabled || atlas->pixelDistScale == 0.0f) return;
+
+	// The distance d is stored as atlas->onedgeValue + atlas->pixelDistScale * d.
+	*scale = draw->pixelDistScale / atlas->pixelDistScale;
+	*bias = ((float)draw->onedgeValue - (float)atlas->onedgeValue * *scale) / 255.0f;
+}
+
+int fonsSetSdfTiers(FONScontext* stash, int font, const float* sizes, int nsizes)
+{
+	FONSfont* f;
+	short tier;
+	int i, j;
+
+	if (stash == NULL || font < 0 || font >= stash->nfonts) return 0;
+	f = stash->fonts[font];
+	if (!f->sdfSettings.sdfEnabled || nsizes > FONS_MAX_SDF_TIERS) return 0;
+	if (stash->params.flags & FONS_COMPACT_VERTICES) return 0;
+
+	f->ntiers = 0;
+	for (i = 0; i < nsizes; i++) {
+		tier = (short)(sizes[i]*10.0f);
+		if (tier < 2) continue;
+		for (j = f->ntiers; j > 0 && f->tiers[j-1] > tier; j--)
+			f->tiers[j] = f->tiers[j-1];
+		f->tiers[j] = tier;
+		f->ntiers++;
+	}
+	return 1;
+}
+
+int fonsSetSizeSteps(FONScontext* stash, int font, int steps)
+{
+	if (stash == NULL || font < 0 || font >= stash->nfonts) return 0;
+	if (steps > 0 && (stash->params.flags & FONS_COMPACT_VERTICES)) return 0;
+	stash->fonts[font]->sizeSteps = steps > 0 ? steps : 0;
+	stash->fonts[font]->nsnapped = 0;
+	stash->fonts[font]->nextSnapped = 0;
+	return 1;
+}
+
+int fonsSetHybridFont(FONScontext* stash, int font, int bitmapFont, float size)
+{
+	FONSfont* f;
+	FONSfont* b;
+
+	if (stash == NULL || font < 0 || font >= stash->nfonts) return 0;
+	f = stash->fonts[font];
+	if (bitmapFont != FONS_INVALID) {
+		if (bitmapFont < 0 || bitmapFont >= stash->nfonts) return 0;
+		b = stash->fonts[bitmapFont];
+		// Kerning looks up the glyph indices of the bitmaps in the face of the SDF font.
+		if (!f->sdfSettings.sdfEnabled || b->sdfSettings.sdfEnabled || b->face != f->face) return 0;
+		if (stash->params.flags & FONS_COMPACT_VERTICES) return 0;
+	}
+	f->bitmapFont = bitmapFont;
+	f->bitmapSize = size;
+	return 1;
+}
+
 int fonsGetFontByName(FONScontext* s, const char* name)
 {
 	int i;
@@ -1146,55 +1971,296 @@ static void fons__blur(FONScontext* stash, unsigned char* dst, int w, int h, int
 //	fons__blurcols(dst, w, h, dstStride, alpha);
 }
 
-static FONSglyph* fons__getGlyph(FONScontext* stash, FONSfont* font, unsigned int codepoint,
-								 short isize, short iblur)
-{
-	int i, g, advance, lsb, x0, y0, x1, y1, gw, gh, gx, gy, x, y;
-	float scale;
-	FONSglyph* glyph = NULL;
-	unsigned int h;
-	float size = isize/10.0f;
-	int pad, added;
-	unsigned char* bdst;
-	unsigned char* dst;
-	FONSfont* renderFont = font;
-
-	if (isize < 2) return NULL;
-	if (iblur > 20) iblur = 20;
-	pad = iblur+2;
-
-	// Reset allocator.
-	stash->nscratch = 0;
+// Glyphs drawn by their index are cached with the index and this bit in place of the codepoint.
+#define FONS_GLYPH_INDEX_KEY 0x80000000u
 
-	// Find code point and size.
-	h = fons__hashint(codepoint) & (FONS_HASH_LUT_SIZE-1);
-	i = font->lut[h];
+static FONSglyph* fons__findGlyphTier(FONSfont* font, unsigned int codepoint, short isize, short rsize, short iblur,
+									  short bitmap)
+{
+	int i = font->lut[fons__hashint(codepoint) & (FONS_HASH_LUT_SIZE-1)];
 	while (i != -1) {
-		if (font->glyphs[i].codepoint == codepoint && font->glyphs[i].size == isize && font->glyphs[i].blur == iblur)
+		if (font->glyphs[i].codepoint == codepoint && font->glyphs[i].size == isize && font->glyphs[i].blur == iblur &&
+			font->glyphs[i].rsize == rsize && font->glyphs[i].bitmap == bitmap)
 			return &font->glyphs[i];
 		i = font->glyphs[i].next;
 	}
+	return NULL;
+}
 
-	// Could not find glyph, create it.
-	g = fons__tt_getGlyphIndex(&font->font, codepoint);
-	// Try to find the glyph in fallback fonts.
-	if (g == 0) {
-		for (i = 0; i < font->nfallbacks; ++i) {
-			FONSfont* fallbackFont = stash->fonts[font->fallbacks[i]];
-			int fallbackIndex = fons__tt_getGlyphIndex(&fallbackFont->font, codepoint);
+static FONSglyph* fons__findGlyph(FONSfont* font, unsigned int codepoint, short isize, short iblur)
+{
+	return fons__findGlyphTier(font, codepoint, isize, isize, iblur, 0);
+}
+
+// Returns true if text of the hybrid font at this size is drawn from bitmaps with the current state.
+static int fons__hybridBitmap(FONScontext* stash, FONSfont* font, short isize)
+{
+	if (font->bitmapFont == FONS_INVALID) return 0;
+	return (float)isize/10.0f * fons__getState(stash)->transformScale < font->bitmapSize;
+}
+
+// The plain font rasterizing the bitmaps of 'renderFont' (the hybrid font or one of its fallbacks), NULL if no
+// plain font was added from the same data.
+static FONSfont* fons__hybridRaster(FONScontext* stash, FONSfont* font, FONSfont* renderFont)
+{
+	int i;
+	if (renderFont == font) return stash->fonts[font->bitmapFont]->raster;
+	for (i = 0; i < stash->nfonts; i++) {
+		if (stash->fonts[i]->face == renderFont->face && !stash->fonts[i]->sdfSettings.sdfEnabled)
+			return stash->fonts[i]->raster;
+	}
+	return NULL;
+}
+
+// The size step for text of size 'isize', see fonsSetSizeSteps(). The step of a new size is remembered only if
+// 'remember' is set, so that queries do not decide it for the text drawn later.
+static short fons__snapSize(FONSfont* font, short isize, int remember)
+{
+	float step, prev;
+	int i, d, nearest = -1, nearestd = 0;
+	short rsize;
+
+	for (i = 0; i < font->nsnapped; i++) {
+		if (font->snapped[i].size == isize) return font->snapped[i].rsize;
+		d = font->snapped[i].size < isize ? isize - font->snapped[i].size : font->snapped[i].size - isize;
+		if (nearest == -1 || d < nearestd) {
+			nearest = i;
+			nearestd = d;
+		}
+	}
+
+	// Keep the step of the nearest size until this one is clearly closer to another step.
+	step = logf((float)isize) * 1.44269504f * (float)font->sizeSteps;
+	rsize = (short)(powf(2.0f, floorf(step + 0.5f) / (float)font->sizeSteps) + 0.5f);
+	if (nearest != -1) {
+		prev = logf((float)font->snapped[nearest].rsize) * 1.44269504f * (float)font->sizeSteps;
+		if (fabsf(step - prev) < 0.5f + FONS_SIZE_HYSTERESIS)
+			rsize = font->snapped[nearest].rsize;
+	}
+	if (rsize < 2) rsize = 2;
+	if (!remember) return rsize;
+
+	if (font->nsnapped < FONS_SIZE_STEP_CACHE_SIZE) {
+		i = font->nsnapped++;
+	} else {
+		i = font->nextSnapped;
+		font->nextSnapped = (i + 1) % FONS_SIZE_STEP_CACHE_SIZE;
+	}
+	font->snapped[i].size = isize;
+	font->snapped[i].rsize = rsize;
+	return rsize;
+}
+
+// The size to rasterize the glyphs of the font at, for text of size 'isize' drawn with the current state. Only
+// drawing the glyphs ('remember') settles the size step of a new size.
+static short fons__rasterSize(FONScontext* stash, FONSfont* font, short isize, int remember)
+{
+	float screen;
+	int i;
+
+	if (fons__hybridBitmap(stash, font, isize)) {
+		// The bitmaps are not magnified nor minified, whole pixels keep zooming to a few sizes.
+		screen = (float)isize * fons__getState(stash)->transformScale;
+		return (short)fons__maxi((int)(screen / 10.0f + 0.5f) * 10, 10);
+	}
+	if (font->ntiers > 0) {
+		screen = (float)isize * fons__getState(stash)->transformScale;
+		for (i = 0; i < font->ntiers-1; i++) {
+			if ((float)font->tiers[i] * FONS_SDF_TIER_MAGNIFY >= screen)
+				break;
+		}
+		return font->tiers[i];
+	}
+
+	if (font->sizeSteps == 0 || isize < 2) return isize;
+	return fons__snapSize(font, isize, remember);
+}
+
+// Finds the glyph (from the fallback fonts if needed) and gets its metrics without rasterizing it. The rect of
+// the glyph is set to the size of its padded bitmap.
+static void fons__getIndexMetrics(FONSfont* font, int g, short isize, short iblur, FONSglyph* glyph, float* scale)
+{
+	int advance, lsb, x0, y0, x1, y1;
+	float size = isize/10.0f;
+	int pad = iblur+2;
+
+	*scale = fons__tt_getPixelHeightScale(&font->face->font, size);
+	fons__tt_buildGlyphBitmap(&font->face->font, g, size, *scale, &advance, &lsb, &x0, &y0, &x1, &y1, &font->sdfSettings);
+
+	glyph->codepoint = FONS_GLYPH_INDEX_KEY | (unsigned int)g;
+	glyph->size = isize;
+	glyph->rsize = isize;
+	glyph->sdf = font->sdfSettings.sdfEnabled;
+	glyph->bitmap = 0;
+	glyph->blur = iblur;
+	glyph->index = g;
+	glyph->x0 = 0;
+	glyph->y0 = 0;
+	glyph->x1 = (short)(x1-x0 + pad*2);
+	glyph->y1 = (short)(y1-y0 + pad*2);
+	glyph->xadv = (short)(*scale * advance * 10.0f);
+	glyph->xoff = (short)(x0 - pad);
+	glyph->yoff = (short)(y0 - pad);
+	glyph->next = -1;
+}
+
+static void fons__getGlyphMetrics(FONScontext* stash, FONSfont* font, unsigned int codepoint, short isize, short iblur,
+								  FONSglyph* glyph, FONSfont** renderFont, float* scale)
+{
+	int i, g;
+	FONScmapEntry* entry = &font->cmap[fons__hashint(codepoint) & (FONS_CMAP_CACHE_SIZE-1)];
+
+	// The same codepoint is looked up again for each new size.
+	if (entry->codepoint == codepoint) {
+		*renderFont = entry->font;
+		fons__getIndexMetrics(*renderFont, entry->index, isize, iblur, glyph, scale);
+		glyph->codepoint = codepoint;
+		return;
+	}
+
+	*renderFont = font;
+	g = fons__tt_getGlyphIndex(&font->face->font, codepoint);
+	// Try to find the glyph in fallback fonts.
+	if (g == 0) {
+		for (i = 0; i < font->nfallbacks; ++i) {
+			FONSfont* fallbackFont = stash->fonts[font->fallbacks[i]];
+			int fallbackIndex;
+			if (!fons__mayCover(fallbackFont->face, codepoint)) continue;
+			fallbackIndex = fons__tt_getGlyphIndex(&fallbackFont->face->font, codepoint);
 			if (fallbackIndex != 0) {
 				g = fallbackIndex;
-				renderFont = fallbackFont;
+				*renderFont = fallbackFont;
 				break;
 			}
 		}
 		// It is possible that we did not find a fallback glyph.
 		// In that case the glyph index 'g' is 0, and we'll proceed below and cache empty glyph.
 	}
-	scale = fons__tt_getPixelHeightScale(&renderFont->font, size);
-	fons__tt_buildGlyphBitmap(&renderFont->font, g, size, scale, &advance, &lsb, &x0, &y0, &x1, &y1, &renderFont->sdfSettings);
-	gw = x1-x0 + pad*2;
-	gh = y1-y0 + pad*2;
+	entry->codepoint = codepoint;
+	entry->font = *renderFont;
+	entry->index = g;
+	fons__getIndexMetrics(*renderFont, g, isize, iblur, glyph, scale);
+	glyph->codepoint = codepoint;
+}
+
+static FONSglyph* fons__findMetrics(FONSfont* font, unsigned int codepoint, short isize, short iblur)
+{
+	int i = font->metricsLut[fons__hashint(codepoint) & (FONS_HASH_LUT_SIZE-1)];
+	while (i != -1) {
+		if (font->metrics[i].codepoint == codepoint && font->metrics[i].size == isize && font->metrics[i].blur == iblur)
+			return &font->metrics[i];
+		i = font->metrics[i].next;
+	}
+	return NULL;
+}
+
+static void fons__addMetrics(FONSfont* font, const FONSglyph* metrics)
+{
+	int i;
+	unsigned int h;
+
+	if (font->nmetrics >= FONS_METRICS_CACHE_SIZE) {
+		font->nmetrics = 0;
+		for (i = 0; i < FONS_HASH_LUT_SIZE; i++)
+			font->metricsLut[i] = -1;
+	}
+	if (font->nmetrics+1 > font->cmetrics) {
+		FONSglyph* grown;
+		int cmetrics = font->cmetrics == 0 ? 64 : font->cmetrics * 2;
+		grown = (FONSglyph*)realloc(font->metrics, sizeof(FONSglyph) * cmetrics);
+		if (grown == NULL) return;
+		font->metrics = grown;
+		font->cmetrics = cmetrics;
+	}
+
+	h = fons__hashint(metrics->codepoint) & (FONS_HASH_LUT_SIZE-1);
+	font->metrics[font->nmetrics] = *metrics;
+	font->metrics[font->nmetrics].next = font->metricsLut[h];
+	font->metricsLut[h] = font->nmetrics++;
+}
+
+// Returns the cached glyph, or only the metrics of the glyph in 'metrics' if it has not been rasterized yet.
+// The metrics are cached separately, so measuring text never touches the atlas.
+static FONSglyph* fons__peekGlyph(FONScontext* stash, FONSfont* font, unsigned int codepoint,
+								  short isize, short iblur, FONSglyph* metrics)
+{
+	FONSglyph* glyph;
+	FONSfont* renderFont;
+	float scale;
+
+	if (isize < 2) return NULL;
+	if (iblur > 20) iblur = 20;
+
+	// Glyphs drawn scaled from another size are not placed like the glyphs of this size, get the metrics.
+	if (font->ntiers == 0 && font->sizeSteps == 0 && font->bitmapFont == FONS_INVALID) {
+		glyph = fons__findGlyph(font, codepoint, isize, iblur);
+		if (glyph != NULL) return glyph;
+	}
+
+	glyph = fons__findMetrics(font, codepoint, isize, iblur);
+	if (glyph != NULL) {
+		*metrics = *glyph;
+		return metrics;
+	}
+
+	fons__getGlyphMetrics(stash, font, codepoint, isize, iblur, metrics, &renderFont, &scale);
+	fons__addMetrics(font, metrics);
+	return metrics;
+}
+
+// Like fons__peekGlyph() for a glyph index of the font.
+static FONSglyph* fons__peekGlyphIndex(FONSfont* font, int index, short isize, short iblur, FONSglyph* metrics)
+{
+	FONSglyph* glyph;
+	float scale;
+
+	if (isize < 2) return NULL;
+	if (iblur > 20) iblur = 20;
+
+	glyph = fons__findGlyph(font->raster, FONS_GLYPH_INDEX_KEY | (unsigned int)index, isize, iblur);
+	if (glyph != NULL) return glyph;
+
+	glyph = fons__findMetrics(font, FONS_GLYPH_INDEX_KEY | (unsigned int)index, isize, iblur);
+	if (glyph != NULL) {
+		*metrics = *glyph;
+		return metrics;
+	}
+
+	fons__getIndexMetrics(font, index, isize, iblur, metrics, &scale);
+	fons__addMetrics(font, metrics);
+	return metrics;
+}
+
+// Rasterizes the glyph of 'renderFont' described by 'metrics' into the atlas and caches it in 'font'.
+// Adds a copy of the glyph to the glyph cache of the font.
+static FONSglyph* fons__insertGlyph(FONSfont* font, const FONSglyph* src)
+{
+	unsigned int h;
+	FONSglyph* glyph = fons__allocGlyph(font);
+	if (glyph == NULL) return NULL;
+	*glyph = *src;
+
+	// Insert char to hash lookup.
+	h = fons__hashint(glyph->codepoint) & (FONS_HASH_LUT_SIZE-1);
+	glyph->next = font->lut[h];
+	font->lut[h] = font->nglyphs-1;
+	return glyph;
+}
+
+static FONSglyph* fons__addGlyph(FONScontext* stash, FONSfont* font, FONSfont* renderFont,
+								 const FONSglyph* metrics, float scale)
+{
+	int gw, gh, gx, gy, x, y;
+	FONSglyph* glyph = NULL;
+	FONSglyph placed;
+	int pad, added;
+	unsigned char* bdst;
+	unsigned char* dst;
+	short iblur = metrics->blur;
+
+	pad = iblur+2;
+	gw = metrics->x1;
+	gh = metrics->y1;
 
 	// Find free spot for the rect in the atlas
 	added = fons__atlasAddRect(stash->atlas, gw, gh, &gx, &gy);
@@ -1206,27 +2272,17 @@ static FONSglyph* fons__getGlyph(FONScontext* stash, FONSfont* font, unsigned in
 	if (added == 0) return NULL;
 
 	// Init glyph.
-	glyph = fons__allocGlyph(font);
-	glyph->codepoint = codepoint;
-	glyph->size = isize;
-	glyph->blur = iblur;
-	glyph->index = g;
-	glyph->x0 = (short)gx;
-	glyph->y0 = (short)gy;
-	glyph->x1 = (short)(glyph->x0+gw);
-	glyph->y1 = (short)(glyph->y0+gh);
-	glyph->xadv = (short)(scale * advance * 10.0f);
-	glyph->xoff = (short)(x0 - pad);
-	glyph->yoff = (short)(y0 - pad);
-	glyph->next = 0;
-
-	// Insert char to hash lookup.
-	glyph->next = font->lut[h];
-	font->lut[h] = font->nglyphs-1;
+	placed = *metrics;
+	placed.x0 = (short)gx;
+	placed.y0 = (short)gy;
+	placed.x1 = (short)(gx+gw);
+	placed.y1 = (short)(gy+gh);
+	glyph = fons__insertGlyph(font, &placed);
+	if (glyph == NULL) return NULL;
 
 	// Rasterize
 	dst = &stash->texData[(glyph->x0+pad) + (glyph->y0+pad) * stash->params.width];
-	fons__tt_renderGlyphBitmap(&renderFont->font, dst, gw-pad*2,gh-pad*2, stash->params.width, scale,scale, g, &renderFont->sdfSettings);
+	fons__tt_renderGlyphBitmap(&renderFont->face->font, dst, gw-pad*2,gh-pad*2, stash->params.width, scale,scale, glyph->index, &renderFont->sdfSettings);
 
 	// Make sure there is one pixel empty border.
 	dst = &stash->texData[glyph->x0 + glyph->y0 * stash->params.width];
@@ -1264,177 +2320,1712 @@ static FONSglyph* fons__getGlyph(FONScontext* stash, FONSfont* font, unsigned in
 	return glyph;
 }
 
-static void fons__getQuad(FONScontext* stash, FONSfont* font,
-						   int prevGlyphIndex, FONSglyph* glyph,
-						   float scale, float spacing, float* x, float* y, FONSquad* q)
+static FONSglyph* fons__getGlyph(FONScontext* stash, FONSfont* font, unsigned int codepoint,
+								 short isize, short iblur)
+{
+	float scale;
+	FONSglyph* glyph = NULL;
+	FONSglyph metrics, placed;
+	FONSfont* renderFont = font;
+	FONSfont* raster;
+	FONSfont* plain;
+	unsigned int key;
+	short rsize, bitmap;
+
+	if (isize < 2) return NULL;
+	if (iblur > 20) iblur = 20;
+
+	// Reset allocator.
+	stash->nscratch = 0;
+
+	// Find code point and size. Hybrid fonts without tiers raster small and large text at the same size, the
+	// bitmap or SDF decision tells them apart.
+	rsize = fons__rasterSize(stash, font, isize, 1);
+	bitmap = (short)fons__hybridBitmap(stash, font, isize);
+	glyph = fons__findGlyphTier(font, codepoint, isize, rsize, iblur, bitmap);
+	if (glyph != NULL) return glyph;
+
+	// Could not find glyph, create it.
+	fons__getGlyphMetrics(stash, font, codepoint, rsize, iblur, &metrics, &renderFont, &scale);
+	raster = renderFont->raster;
+
+	// Small text of a hybrid font, found through the fallbacks of the SDF font and drawn from plain bitmaps of
+	// the same face.
+	if (bitmap) {
+		plain = fons__hybridRaster(stash, font, renderFont);
+		if (plain != NULL) {
+			fons__getIndexMetrics(plain, metrics.index, rsize, iblur, &metrics, &scale);
+			renderFont = raster = plain;
+		}
+	}
+
+	// The glyph may have been rasterized already for another codepoint of the same glyph, or for another font
+	// of the same face and settings, e.g. a fallback font shared by several fonts.
+	key = FONS_GLYPH_INDEX_KEY | (unsigned int)metrics.index;
+	glyph = fons__findGlyph(raster, key, rsize, iblur);
+	if (glyph == NULL) {
+		metrics.codepoint = key;
+		glyph = fons__addGlyph(stash, raster, renderFont, &metrics, scale);
+		if (glyph == NULL) return NULL;
+	}
+	metrics = *glyph;
+	metrics.codepoint = codepoint;
+	metrics.bitmap = bitmap;
+	if (rsize != isize) {
+		// Drawn from the bitmap of the other size, but advances like the glyph of the requested size.
+		glyph = fons__peekGlyph(stash, font, codepoint, isize, iblur, &placed);
+		if (glyph == NULL) return NULL;
+		metrics.size = isize;
+		metrics.xadv = glyph->xadv;
+	}
+	return fons__insertGlyph(font, &metrics);
+}
+
+// Like fons__getGlyph() for a glyph index of the font, skips the cmap and the fallback fonts.
+static FONSglyph* fons__getGlyphIndex(FONScontext* stash, FONSfont* font, int index, short isize, short iblur)
+{
+	float scale;
+	FONSglyph* glyph = NULL;
+	FONSglyph metrics;
+
+	if (isize < 2) return NULL;
+	if (iblur > 20) iblur = 20;
+
+	stash->nscratch = 0;
+
+	// Kept with the glyphs that fonts of the same face and settings share.
+	glyph = fons__findGlyph(font->raster, FONS_GLYPH_INDEX_KEY | (unsigned int)index, isize, iblur);
+	if (glyph != NULL) return glyph;
+
+	fons__getIndexMetrics(font, index, isize, iblur, &metrics, &scale);
+	return fons__addGlyph(stash, font->raster, font, &metrics, scale);
+}
+
+static int fons__kernAdvance(FONSface* face, int glyph1, int glyph2)
+{
+	unsigned int pair = ((unsigned int)glyph1 << 16) | ((unsigned int)glyph2 & 0xffff);
+	FONSkernEntry* entry = &face->kerns[fons__hashint(pair) & (FONS_KERN_CACHE_SIZE-1)];
+	if (entry->pair != pair) {
+		entry->pair = pair;
+		entry->advance = fons__tt_getGlyphKernAdvance(&face->font, glyph1, glyph2);
+	}
+	return entry->advance;
+}
+
+static void fons__getQuad(FONScontext* stash, FONSfont* font,
+						   int prevGlyphIndex, FONSglyph* glyph,
+						   float scale, float spacing, float* x, float* y, FONSquad* q)
+{
+	float rx,ry,xoff,yoff,x0,y0,x1,y1,w,h,s;
+
+	if (prevGlyphIndex != -1) {
+		float adv = fons__kernAdvance(font->face, prevGlyphIndex, glyph->index) * scale;
+		*x += (int)(adv + spacing + 0.5f);
+	}
+
+	// Each glyph has 2px border to allow good interpolation,
+	// one pixel to prevent leaking, and one to allow good interpolation for rendering.
+	// Inset the texture region by one pixel for correct interpolation.
+	xoff = (short)(glyph->xoff+1);
+	yoff = (short)(glyph->yoff+1);
+	x0 = (float)(glyph->x0+1);
+	y0 = (float)(glyph->y0+1);
+	x1 = (float)(glyph->x1-1);
+	y1 = (float)(glyph->y1-1);
+	w = x1 - x0;
+	h = y1 - y0;
+
+	if (stash->params.flags & FONS_ZERO_TOPLEFT) {
+		rx = *x + xoff;
+		ry = *y + yoff;
+	} else {
+		rx = *x + xoff;
+		ry = *y - yoff;
+		h = -h;
+	}
+
+	if (glyph->rsize != glyph->size) {
+		// A bitmap of another size scaled to the size of the text. Not snapped, the size may be animated or the
+		// text transformed.
+		s = (float)glyph->size / (float)glyph->rsize;
+		rx = *x + xoff * s;
+		ry = *y + (ry - *y) * s;
+		w *= s;
+		h *= s;
+	} else {
+		rx = (float)(int)rx;
+		ry = (float)(int)ry;
+	}
+
+	q->x0 = rx;
+	q->y0 = ry;
+	q->x1 = rx + w;
+	q->y1 = ry + h;
+
+	q->s0 = x0 * stash->itw;
+	q->t0 = y0 * stash->ith;
+	q->s1 = x1 * stash->itw;
+	q->t1 = y1 * stash->ith;
+
+	// Tag the bitmaps of hybrid fonts for the shader.
+	if (font->bitmapFont != FONS_INVALID && !glyph->sdf) {
+		q->s0 += FONS_HYBRID_BITMAP_TAG;
+		q->s1 += FONS_HYBRID_BITMAP_TAG;
+	}
+
+	*x += (int)(glyph->xadv / 10.0f + 0.5f);
+}
+
+static void fons__flush(FONScontext* stash)
+{
+	// Flush texture
+	if (stash->dirtyRect[0] < stash->dirtyRect[2] && stash->dirtyRect[1] < stash->dirtyRect[3]) {
+		if (stash->params.renderUpdate != NULL)
+			stash->params.renderUpdate(stash->params.userPtr, stash->dirtyRect, stash->texData);
+		// Reset dirty rect
+		stash->dirtyRect[0] = stash->params.width;
+		stash->dirtyRect[1] = stash->params.height;
+		stash->dirtyRect[2] = 0;
+		stash->dirtyRect[3] = 0;
+	}
+
+	// Flush triangles
+	if (stash->nverts > 0) {
+		if (stash->params.renderDraw != NULL)
+			stash->params.renderDraw(stash->params.userPtr, stash->verts, stash->nverts);
+		stash->nverts = 0;
+	}
+	// Mapped memory is only valid until the next draw.
+	stash->verts = NULL;
+
+	// Flush instances
+	if (stash->ninsts > 0) {
+		stash->params.renderDrawInstanced(stash->params.userPtr, stash->insts, stash->ninsts);
+		stash->ninsts = 0;
+	}
+}
+
+static int fons__growArena(FONScontext* stash, int nverts)
+{
+	FONSvertex* arena;
+	int count = stash->carena;
+	if (nverts <= count) return 1;
+	if (nverts > FONS_MAX_VERTEX_COUNT) return 0;
+	while (count < nverts)
+		count *= 2;
+	count = fons__mini(count, FONS_MAX_VERTEX_COUNT);
+	arena = (FONSvertex*)realloc(stash->arena, sizeof(FONSvertex) * count);
+	if (arena == NULL) return 0;
+	if (stash->verts == stash->arena) {
+		stash->verts = arena;
+		stash->cverts = count;
+	}
+	stash->arena = arena;
+	stash->carena = count;
+	return 1;
+}
+
+// Makes sure there is space for 'nverts' more vertices. The arena grows in place, flushing only happens when
+// mapped memory or FONS_MAX_VERTEX_COUNT runs out.
+static void fons__reserveVerts(FONScontext* stash, int nverts)
+{
+	int count;
+	if (stash->verts != NULL) {
+		if (stash->nverts+nverts <= stash->cverts)
+			return;
+		if (stash->verts == stash->arena && fons__growArena(stash, stash->nverts+nverts))
+			return;
+		fons__flush(stash);
+	}
+	count = fons__maxi(nverts, FONS_VERTEX_COUNT);
+	if (stash->params.renderMapVertices != NULL) {
+		stash->verts = stash->params.renderMapVertices(stash->params.userPtr, count);
+		stash->cverts = count;
+	}
+	if (stash->verts == NULL) {
+		stash->verts = stash->arena;
+		stash->cverts = stash->carena;
+		fons__growArena(stash, nverts);
+	}
+}
+
+// Instances are capped to the same number of glyphs as vertices.
+static int fons__growInstances(FONScontext* stash)
+{
+	FONSinstance* insts;
+	int count = fons__mini(stash->cinsts * 2, FONS_MAX_VERTEX_COUNT / 6);
+	if (count <= stash->cinsts) return 0;
+	insts = (FONSinstance*)realloc(stash->insts, sizeof(FONSinstance) * count);
+	if (insts == NULL) return 0;
+	stash->insts = insts;
+	stash->cinsts = count;
+	return 1;
+}
+
+// Reserves space for 'nquads' quads up front, so that a whole string goes out with one draw call.
+static void fons__reserveQuads(FONScontext* stash, int nquads)
+{
+	if (stash->capture != NULL || stash->batching)
+		return;
+	if ((stash->params.flags & FONS_INSTANCED) && stash->params.renderDrawInstanced != NULL)
+		return;
+	fons__reserveVerts(stash, fons__mini(nquads, FONS_MAX_VERTEX_COUNT / 6) * 6);
+}
+
+static __inline void fons__vertex(FONScontext* stash, float x, float y, float s, float t, unsigned int c)
+{
+	FONSvertex* v = &stash->verts[stash->nverts++];
+	v->x = x;
+	v->y = y;
+	v->s = s;
+	v->t = t;
+	v->color = c;
+}
+
+static float fons__getVertAlign(FONScontext* stash, FONSfont* font, int align, short isize)
+{
+	if (stash->params.flags & FONS_ZERO_TOPLEFT) {
+		if (align & FONS_ALIGN_TOP) {
+			return font->face->ascender * (float)isize/10.0f;
+		} else if (align & FONS_ALIGN_MIDDLE) {
+			return (font->face->ascender + font->face->descender) / 2.0f * (float)isize/10.0f;
+		} else if (align & FONS_ALIGN_BASELINE) {
+			return 0.0f;
+		} else if (align & FONS_ALIGN_BOTTOM) {
+			return font->face->descender * (float)isize/10.0f;
+		}
+	} else {
+		if (align & FONS_ALIGN_TOP) {
+			return -font->face->ascender * (float)isize/10.0f;
+		} else if (align & FONS_ALIGN_MIDDLE) {
+			return -(font->face->ascender + font->face->descender) / 2.0f * (float)isize/10.0f;
+		} else if (align & FONS_ALIGN_BASELINE) {
+			return 0.0f;
+		} else if (align & FONS_ALIGN_BOTTOM) {
+			return -font->face->descender * (float)isize/10.0f;
+		}
+	}
+	return 0.0;
+}
+
+static int fons__bufferReserve(FONStextBuffer* buffer, int nverts)
+{
+	int cverts;
+	if (buffer->nverts+nverts <= buffer->cverts)
+		return 1;
+	cverts = buffer->cverts == 0 ? FONS_VERTEX_COUNT : buffer->cverts;
+	while (cverts < buffer->nverts+nverts)
+		cverts *= 2;
+	buffer->verts = (FONSvertex*)realloc(buffer->verts, sizeof(FONSvertex) * cverts);
+	if (buffer->verts == NULL) {
+		buffer->nverts = buffer->cverts = 0;
+		return 0;
+	}
+	buffer->cverts = cverts;
+	return 1;
+}
+
+static __inline void fons__setVertex(FONSvertex* v, float x, float y, float s, float t, unsigned int c)
+{
+	v->x = x;
+	v->y = y;
+	v->s = s;
+	v->t = t;
+	v->color = c;
+}
+
+// Writes the two triangles of a quad.
+static void fons__quadVertices(FONSvertex* v, const FONSquad* q, unsigned int color)
+{
+	fons__setVertex(&v[0], q->x0, q->y0, q->s0, q->t0, color);
+	fons__setVertex(&v[1], q->x1, q->y1, q->s1, q->t1, color);
+	fons__setVertex(&v[2], q->x1, q->y0, q->s1, q->t0, color);
+
+	fons__setVertex(&v[3], q->x0, q->y0, q->s0, q->t0, color);
+	fons__setVertex(&v[4], q->x0, q->y1, q->s0, q->t1, color);
+	fons__setVertex(&v[5], q->x1, q->y1, q->s1, q->t1, color);
+}
+
+static void fons__quadInstance(FONScontext* stash, FONSinstance* inst, const FONSquad* q, unsigned int color)
+{
+	inst->x = q->x0;
+	inst->y = q->y0;
+	inst->w = q->x1 - q->x0;
+	inst->h = q->y1 - q->y0;
+	inst->s0 = (unsigned short)(q->s0 * stash->params.width + 0.5f);
+	inst->t0 = (unsigned short)(q->t0 * stash->params.height + 0.5f);
+	inst->s1 = (unsigned short)(q->s1 * stash->params.width + 0.5f);
+	inst->t1 = (unsigned short)(q->t1 * stash->params.height + 0.5f);
+	inst->color = color;
+}
+
+static int fons__batchReserve(FONSbatch* batch, int nverts, int ninsts)
+{
+	int count;
+	if (batch->nverts+nverts > batch->cverts) {
+		count = batch->cverts == 0 ? FONS_VERTEX_COUNT : batch->cverts;
+		while (count < batch->nverts+nverts)
+			count *= 2;
+		batch->verts = (FONSvertex*)realloc(batch->verts, sizeof(FONSvertex) * count);
+		if (batch->verts == NULL) {
+			batch->nverts = batch->cverts = 0;
+			return 0;
+		}
+		batch->cverts = count;
+	}
+	if (batch->ninsts+ninsts > batch->cinsts) {
+		count = batch->cinsts == 0 ? FONS_INSTANCE_COUNT : batch->cinsts;
+		while (count < batch->ninsts+ninsts)
+			count *= 2;
+		batch->insts = (FONSinstance*)realloc(batch->insts, sizeof(FONSinstance) * count);
+		if (batch->insts == NULL) {
+			batch->ninsts = batch->cinsts = 0;
+			return 0;
+		}
+		batch->cinsts = count;
+	}
+	return 1;
+}
+
+static FONSbatch* fons__getBatch(FONScontext* stash, int key)
+{
+	FONSbatch* batches;
+	int i;
+
+	if (stash->batch != NULL && stash->batch->key == key)
+		return stash->batch;
+
+	for (i = 0; i < stash->nbatches && stash->batches[i].key < key; i++) {}
+	if (i < stash->nbatches && stash->batches[i].key == key) {
+		stash->batch = &stash->batches[i];
+		return stash->batch;
+	}
+
+	// Insert a new batch, keeping the keys sorted.
+	if (stash->nbatches+1 > stash->cbatches) {
+		batches = (FONSbatch*)realloc(stash->batches, sizeof(FONSbatch) * (stash->cbatches == 0 ? 8 : stash->cbatches * 2));
+		if (batches == NULL) return NULL;
+		stash->batches = batches;
+		stash->cbatches = stash->cbatches == 0 ? 8 : stash->cbatches * 2;
+	}
+	memmove(&stash->batches[i+1], &stash->batches[i], sizeof(FONSbatch) * (stash->nbatches - i));
+	memset(&stash->batches[i], 0, sizeof(FONSbatch));
+	stash->batches[i].key = key;
+	stash->nbatches++;
+
+	stash->batch = &stash->batches[i];
+	return stash->batch;
+}
+
+static void fons__freeBatches(FONScontext* stash)
+{
+	int i;
+	for (i = 0; i < stash->nbatches; i++) {
+		if (stash->batches[i].verts) free(stash->batches[i].verts);
+		if (stash->batches[i].insts) free(stash->batches[i].insts);
+	}
+	if (stash->batches) free(stash->batches);
+}
+
+static void fons__emitQuad(FONScontext* stash, const FONSquad* q, unsigned int color)
+{
+	FONStextBuffer* buffer = stash->capture;
+	FONSbatch* batch;
+	int instanced = (stash->params.flags & FONS_INSTANCED) && stash->params.renderDrawInstanced != NULL;
+
+	// Appending to a text buffer.
+	if (buffer != NULL) {
+		if (!fons__bufferReserve(buffer, 6))
+			return;
+		fons__quadVertices(&buffer->verts[buffer->nverts], q, color);
+		buffer->nverts += 6;
+		buffer->dirty = 1;
+		return;
+	}
+
+	// Collecting a frame.
+	if (stash->batching) {
+		batch = fons__getBatch(stash, fons__getState(stash)->batchKey);
+		if (batch == NULL || !fons__batchReserve(batch, instanced ? 0 : 6, instanced ? 1 : 0))
+			return;
+		if (instanced) {
+			fons__quadInstance(stash, &batch->insts[batch->ninsts++], q, color);
+		} else {
+			fons__quadVertices(&batch->verts[batch->nverts], q, color);
+			batch->nverts += 6;
+		}
+		return;
+	}
+
+	if (instanced) {
+		if (stash->ninsts+1 > stash->cinsts && !fons__growInstances(stash))
+			fons__flush(stash);
+		fons__quadInstance(stash, &stash->insts[stash->ninsts++], q, color);
+		return;
+	}
+
+	fons__reserveVerts(stash, 6);
+	fons__quadVertices(&stash->verts[stash->nverts], q, color);
+	stash->nverts += 6;
+}
+
+// FNV-1a
+static unsigned int fons__hashstr(const char* str, const char* end)
+{
+	unsigned int h = 2166136261u;
+	for (; str != end; ++str)
+		h = (h ^ *(const unsigned char*)str) * 16777619u;
+	return h;
+}
+
+static void fons__freeRuns(FONScontext* stash)
+{
+	int i;
+	for (i = 0; i < FONS_RUN_CACHE_SIZE; i++) {
+		if (stash->runs[i].str) free(stash->runs[i].str);
+		if (stash->runs[i].quads) free(stash->runs[i].quads);
+	}
+	memset(stash->runs, 0, sizeof(stash->runs));
+	if (stash->layout.quads) free(stash->layout.quads);
+	memset(&stash->layout, 0, sizeof(stash->layout));
+}
+
+static int fons__runMatches(FONScontext* stash, FONSrun* run, FONSstate* state, unsigned int hash,
+							short isize, short rsize, short bitmap, short iblur, const char* str, int nstr)
+{
+	return run->nstr == nstr && run->hash == hash && run->generation == stash->atlasGeneration &&
+		run->font == state->font && run->isize == isize && run->rsize == rsize && run->bitmap == bitmap &&
+		run->iblur == iblur &&
+		run->spacing == state->spacing && run->align == state->align &&
+		memcmp(run->str, str, nstr) == 0;
+}
+
+// Runs are stored in a two way set associative cache, the least recently used run of the set is replaced.
+static FONSrun* fons__findRun(FONScontext* stash, FONSstate* state, unsigned int hash,
+							  short isize, short rsize, short bitmap, short iblur, const char* str, int nstr,
+							  FONSrun** replace)
+{
+	FONSrun* a = &stash->runs[hash & (FONS_RUN_CACHE_SIZE-1)];
+	FONSrun* b = &stash->runs[(hash & (FONS_RUN_CACHE_SIZE-1)) ^ 1];
+
+	stash->runCounter++;
+	if (fons__runMatches(stash, a, state, hash, isize, rsize, bitmap, iblur, str, nstr)) {
+		a->lastUsed = stash->runCounter;
+		return a;
+	}
+	if (fons__runMatches(stash, b, state, hash, isize, rsize, bitmap, iblur, str, nstr)) {
+		b->lastUsed = stash->runCounter;
+		return b;
+	}
+	*replace = a->lastUsed <= b->lastUsed ? a : b;
+	return NULL;
+}
+
+// Lays out the string at the origin, the alignment is stored in dx and dy. Returns 0 if a glyph is missing,
+// unless 'skipMissing' is set.
+static int fons__layoutRun(FONScontext* stash, FONSrun* run, FONSstate* state, FONSfont* font,
+						   short isize, short iblur, float scale, const char* str, const char* end, int skipMissing)
+{
+	unsigned int codepoint;
+	unsigned int utf8state = 0;
+	unsigned int cps[FONS_DECODE_CHUNK];
+	int i, ncps;
+	FONSglyph* glyph;
+	int prevGlyphIndex = -1;
+	float x = 0.0f, y = 0.0f;
+
+	run->nquads = 0;
+	while (str != end) {
+		ncps = fons__decodeUtf8(&utf8state, &codepoint, &str, end, cps, FONS_DECODE_CHUNK);
+		for (i = 0; i < ncps; i++) {
+			glyph = fons__getGlyph(stash, font, cps[i], isize, iblur);
+			if (glyph == NULL) {
+				if (!skipMissing) return 0;
+				prevGlyphIndex = -1;
+				continue;
+			}
+			if (run->nquads+1 > run->cquads) {
+				run->cquads = run->cquads == 0 ? 16 : run->cquads * 2;
+				run->quads = (FONSquad*)realloc(run->quads, sizeof(FONSquad) * run->cquads);
+				if (run->quads == NULL) {
+					run->nquads = run->cquads = 0;
+					return 0;
+				}
+			}
+			fons__getQuad(stash, font, prevGlyphIndex, glyph, scale, state->spacing, &x, &y, &run->quads[run->nquads++]);
+			prevGlyphIndex = glyph->index;
+		}
+	}
+
+	run->advance = x;
+	run->dx = 0.0f;
+	if (state->align & FONS_ALIGN_LEFT) {
+		// empty
+	} else if (state->align & FONS_ALIGN_RIGHT) {
+		run->dx = -x;
+	} else if (state->align & FONS_ALIGN_CENTER) {
+		run->dx = -x * 0.5f;
+	}
+	run->dy = fons__getVertAlign(stash, font, state->align, isize);
+	return 1;
+}
+
+static FONSrun* fons__buildRun(FONScontext* stash, FONSrun* run, FONSstate* state, FONSfont* font, unsigned int hash,
+							   short isize, short iblur, float scale, const char* str, const char* end)
+{
+	int generation = stash->atlasGeneration;
+	int nstr = (int)(end - str);
+
+	// Invalidate the old contents first, in case we bail out.
+	run->nstr = 0;
+	run->nquads = 0;
+	if (run->str == NULL) {
+		run->str = (char*)malloc(FONS_RUN_MAX_BYTES);
+		if (run->str == NULL) return NULL;
+	}
+
+	// Missing glyphs (e.g. full atlas) are not cached, let the caller draw the string the slow way.
+	if (!fons__layoutRun(stash, run, state, font, isize, iblur, scale, str, end, 0)) return NULL;
+
+	// The atlas was reset or resized while adding the glyphs.
+	if (generation != stash->atlasGeneration) return NULL;
+
+	run->hash = hash;
+	run->font = state->font;
+	run->align = state->align;
+	run->isize = isize;
+	run->rsize = fons__rasterSize(stash, font, isize, 0);
+	run->bitmap = (short)fons__hybridBitmap(stash, font, isize);
+	run->iblur = iblur;
+	run->spacing = state->spacing;
+	run->generation = generation;
+	run->lastUsed = stash->runCounter;
+	memcpy(run->str, str, nstr);
+	run->nstr = nstr;
+
+	return run;
+}
+
+static int fons__quadVisible(const FONSquad* q, const float* clip)
+{
+	// Quads are upside down with FONS_ZERO_BOTTOMLEFT.
+	float miny = q->y0 < q->y1 ? q->y0 : q->y1;
+	float maxy = q->y0 < q->y1 ? q->y1 : q->y0;
+	return q->x1 >= clip[0] && q->x0 <= clip[2] && maxy >= clip[1] && miny <= clip[3];
+}
+
+// Advance of the string from glyph metrics, without rasterizing the glyphs.
+static float fons__measureAdvance(FONScontext* stash, FONSfont* font, FONSstate* state, short isize, short iblur,
+								  float scale, const char* str, const char* end)
+{
+	unsigned int codepoint;
+	unsigned int utf8state = 0;
+	unsigned int cps[FONS_DECODE_CHUNK];
+	int i, ncps;
+	FONSglyph metrics;
+	FONSglyph* glyph;
+	FONSquad q;
+	int prevGlyphIndex = -1;
+	float x = 0.0f, y = 0.0f;
+
+	while (str != end) {
+		ncps = fons__decodeUtf8(&utf8state, &codepoint, &str, end, cps, FONS_DECODE_CHUNK);
+		for (i = 0; i < ncps; i++) {
+			glyph = fons__peekGlyph(stash, font, cps[i], isize, iblur, &metrics);
+			if (glyph != NULL)
+				fons__getQuad(stash, font, prevGlyphIndex, glyph, scale, state->spacing, &x, &y, &q);
+			prevGlyphIndex = glyph != NULL ? glyph->index : -1;
+		}
+	}
+	return x;
+}
+
+static float fons__drawRun(FONScontext* stash, FONSrun* run, float x, float y, unsigned int color, const float* clip)
+{
+	int i;
+	float dx, dy;
+	FONSquad q;
+
+	x += run->dx;
+	y += run->dy;
+
+	for (i = 0; i < run->nquads; i++) {
+		const FONSquad* rq = &run->quads[i];
+		// Snap like fons__getQuad does, the stored positions are whole pixels relative to the pen.
+		if (run->rsize == run->isize) {
+			dx = (float)(int)(x + rq->x0) - rq->x0;
+			dy = (float)(int)(y + rq->y0) - rq->y0;
+		} else {
+			dx = x;
+			dy = y;
+		}
+		q.x0 = rq->x0 + dx;
+		q.y0 = rq->y0 + dy;
+		q.x1 = rq->x1 + dx;
+		q.y1 = rq->y1 + dy;
+		q.s0 = rq->s0;
+		q.t0 = rq->t0;
+		q.s1 = rq->s1;
+		q.t1 = rq->t1;
+		if (clip == NULL || fons__quadVisible(&q, clip))
+			fons__emitQuad(stash, &q, color);
+	}
+
+	return x + run->advance;
+}
+
+// Draws decoded codepoints from the pen position (x, y), continuing the kerning from 'prevGlyphIndex'.
+static float fons__drawCodepoints(FONScontext* stash, FONSfont* font, FONSstate* state, short isize, short iblur,
+								  float scale, float x, float y, const unsigned int* cps, int ncps,
+								  int* prevGlyphIndex, const float* clip)
+{
+	FONSglyph* glyph = NULL;
+	FONSglyph metrics;
+	FONSquad q;
+	float px;
+	int i;
+
+	for (i = 0; i < ncps; i++) {
+		if (clip != NULL) {
+			// Place the glyph using its metrics first, only visible glyphs are rasterized.
+			px = x;
+			glyph = fons__peekGlyph(stash, font, cps[i], isize, iblur, &metrics);
+			if (glyph != NULL) {
+				fons__getQuad(stash, font, *prevGlyphIndex, glyph, scale, state->spacing, &x, &y, &q);
+				if (fons__quadVisible(&q, clip)) {
+					if (glyph == &metrics && (glyph = fons__getGlyph(stash, font, cps[i], isize, iblur)) != NULL) {
+						x = px;
+						fons__getQuad(stash, font, *prevGlyphIndex, glyph, scale, state->spacing, &x, &y, &q);
+					}
+					if (glyph != NULL)
+						fons__emitQuad(stash, &q, state->color);
+				}
+			}
+		} else {
+			glyph = fons__getGlyph(stash, font, cps[i], isize, iblur);
+			if (glyph != NULL) {
+				fons__getQuad(stash, font, *prevGlyphIndex, glyph, scale, state->spacing, &x, &y, &q);
+				fons__emitQuad(stash, &q, state->color);
+			}
+		}
+		*prevGlyphIndex = glyph != NULL ? glyph->index : -1;
+	}
+
+	return x;
+}
+
+static float fons__drawGreeked(FONScontext* stash, FONSfont* font, FONSstate* state, short isize,
+							   float x, float y, const char* str, const char* end, const float* clip);
+
+// Returns 0 if the font of the state is not valid.
+static int fons__resolveStyle(FONScontext* stash, const FONSstate* state, FONSstyle* style)
+{
+	if (state->font < 0 || state->font >= stash->nfonts) return 0;
+	style->font = stash->fonts[state->font];
+	if (style->font->face == NULL) return 0;
+
+	style->state = *state;
+	style->isize = (short)(state->size*10.0f);
+	style->iblur = (short)state->blur;
+	style->scale = fons__tt_getPixelHeightScale(&style->font->face->font, (float)style->isize/10.0f);
+	style->dy = fons__getVertAlign(stash, style->font, state->align, style->isize);
+	return 1;
+}
+
+static FONSstyle* fons__getStyle(FONScontext* stash, int style)
+{
+	if (stash == NULL || style < 0 || style >= stash->nstyles) return NULL;
+	return stash->styles[style];
+}
+
+// Like fonsDrawTextStyled() but leaves the vertices pending.
+static float fons__drawTextStyle(FONScontext* stash, FONSstyle* style,
+								 float x, float y,
+								 const char* str, const char* end)
+{
+	FONSstate* state = &style->state;
+	unsigned int codepoint;
+	unsigned int utf8state = 0;
+	int prevGlyphIndex = -1;
+	short isize = style->isize;
+	short iblur = style->iblur;
+	float scale = style->scale;
+	FONSfont* font = style->font;
+	float width;
+	unsigned int cps[FONS_DECODE_CHUNK];
+	int i, ncps;
+	const float* clip = NULL;
+
+	if (end == NULL)
+		end = str + strlen(str);
+
+	// Text too small to read is drawn without looking up its glyphs.
+	if (state->greekMode != FONS_GREEK_NONE && (float)isize/10.0f < state->greekSize)
+		return fons__drawGreeked(stash, font, state, isize, x, y, str, end,
+								 state->clipping && stash->capture == NULL ? state->clip : NULL);
+
+	// Text buffers are drawn with transforms, don't clip what is captured to them.
+	if (state->clipping && stash->capture == NULL) {
+		// Glyphs stay within about one size from the baseline, plus the padding of the bitmap.
+		float baseline = y + style->dy;
+		float extent = (float)isize/10.0f + iblur + 2 + (font->sdfSettings.sdfEnabled ? font->sdfSettings.padding : 0);
+		if (baseline + extent < state->clip[1] || baseline - extent > state->clip[3])
+			return x;
+		clip = state->clip;
+
+		// Cache (and rasterize) whole strings only if they cannot reach outside the rect horizontally.
+		extent = (float)(end - str) * ((float)isize/10.0f + state->spacing) + extent;
+		if (x - extent < clip[0] || x + extent > clip[2])
+			goto culled;
+	}
+
+	// Short strings are laid out once and then drawn from the run cache.
+	if (end - str > 0 && end - str <= FONS_RUN_MAX_BYTES) {
+		// Mix in the style too, so that the same string in different styles does not compete for one slot.
+		unsigned int hash = fons__hashstr(str, end) ^ fons__hashint((unsigned int)(state->font ^ (isize << 8) ^ (iblur << 20) ^ (state->align << 24)));
+		FONSrun* replace = NULL;
+		FONSrun* run = fons__findRun(stash, state, hash, isize, fons__rasterSize(stash, font, isize, 0),
+									 (short)fons__hybridBitmap(stash, font, isize), iblur, str, (int)(end - str),
+									 &replace);
+		if (run == NULL)
+			run = fons__buildRun(stash, replace, state, font, hash, isize, iblur, scale, str, end);
+		if (run != NULL) {
+			fons__reserveQuads(stash, run->nquads);
+			return fons__drawRun(stash, run, x, y, state->color, clip);
+		}
+	}
+
+	// Right and center aligned text is laid out once at the origin and then moved in place, instead of
+	// measuring it first. Lay out again if the atlas changed while adding the glyphs.
+	if (!(state->align & FONS_ALIGN_LEFT) && (state->align & (FONS_ALIGN_RIGHT | FONS_ALIGN_CENTER))) {
+		for (i = 0; i < 2; i++) {
+			int generation = stash->atlasGeneration;
+			if (!fons__layoutRun(stash, &stash->layout, state, font, isize, iblur, scale, str, end, 1))
+				break;
+			if (generation == stash->atlasGeneration) {
+				fons__reserveQuads(stash, stash->layout.nquads);
+				return fons__drawRun(stash, &stash->layout, x, y, state->color, clip);
+			}
+		}
+	}
+
+culled:
+	// Align horizontally
+	if (state->align & FONS_ALIGN_LEFT) {
+		// empty
+	} else if (state->align & FONS_ALIGN_RIGHT) {
+		width = fons__measureAdvance(stash, font, state, isize, iblur, scale, str, end);
+		x -= width;
+	} else if (state->align & FONS_ALIGN_CENTER) {
+		width = fons__measureAdvance(stash, font, state, isize, iblur, scale, str, end);
+		x -= width * 0.5f;
+	}
+	// Align vertically.
+	y += style->dy;
+
+	// There are at most as many glyphs as bytes.
+	fons__reserveQuads(stash, (int)(end - str));
+
+	while (str != end) {
+		ncps = fons__decodeUtf8(&utf8state, &codepoint, &str, end, cps, FONS_DECODE_CHUNK);
+		x = fons__drawCodepoints(stash, font, state, isize, iblur, scale, x, y, cps, ncps, &prevGlyphIndex, clip);
+	}
+
+	return x;
+}
+
+// Like fonsDrawText() but leaves the vertices pending.
+static float fons__drawText(FONScontext* stash,
+							float x, float y,
+							const char* str, const char* end)
+{
+	FONSstyle style;
+	if (stash == NULL) return x;
+	if (!fons__resolveStyle(stash, fons__getState(stash), &style)) return x;
+	return fons__drawTextStyle(stash, &style, x, y, str, end);
+}
+
+FONS_DEF int fonsCreateStyle(FONScontext* stash)
+{
+	int i;
+	FONSstyle* style;
+	if (stash == NULL) return FONS_INVALID;
+
+	style = (FONSstyle*)malloc(sizeof(FONSstyle));
+	if (style == NULL) return FONS_INVALID;
+	if (!fons__resolveStyle(stash, fons__getState(stash), style)) {
+		free(style);
+		return FONS_INVALID;
+	}
+
+	// Reuse a free slot if possible.
+	for (i = 0; i < stash->nstyles; i++) {
+		if (stash->styles[i] == NULL) {
+			stash->styles[i] = style;
+			return i;
+		}
+	}
+	stash->styles = (FONSstyle**)realloc(stash->styles, sizeof(FONSstyle*) * (stash->nstyles+1));
+	if (stash->styles == NULL) {
+		stash->nstyles = 0;
+		free(style);
+		return FONS_INVALID;
+	}
+	stash->styles[stash->nstyles++] = style;
+	return stash->nstyles-1;
+}
+
+FONS_DEF void fonsDeleteStyle(FONScontext* stash, int style)
+{
+	FONSstyle* s = fons__getStyle(stash, style);
+	if (s == NULL) return;
+	free(s);
+	stash->styles[style] = NULL;
+}
+
+FONS_DEF float fonsDrawTextStyled(FONScontext* stash, int style, float x, float y, const char* str, const char* end)
+{
+	FONSstyle* s = fons__getStyle(stash, style);
+	if (s == NULL) return x;
+	x = fons__drawTextStyle(stash, s, x, y, str, end);
+	fons__flush(stash);
+	return x;
+}
+
+FONS_DEF float fonsDrawText(FONScontext* stash,
+				   float x, float y,
+				   const char* str, const char* end)
+{
+	if (stash == NULL) return x;
+	x = fons__drawText(stash, x, y, str, end);
+	fons__flush(stash);
+	return x;
+}
+
+FONS_DEF float fonsDrawTextSpans(FONScontext* stash, float x, float y, const FONStextSpan* spans, int nspans)
+{
+	FONSstate* state;
+	int i, align;
+	unsigned int color;
+	float width = 0.0f;
+
+	if (stash == NULL) return x;
+	state = fons__getState(stash);
+	align = state->align;
+	color = state->color;
+
+	// Align the spans together, then draw them left aligned.
+	if (align & FONS_ALIGN_LEFT) {
+		// empty
+	} else if (align & (FONS_ALIGN_RIGHT | FONS_ALIGN_CENTER)) {
+		for (i = 0; i < nspans; i++)
+			width += fonsTextBounds(stash, 0, 0, spans[i].str, spans[i].end, NULL);
+		x -= (align & FONS_ALIGN_RIGHT) ? width : width * 0.5f;
+	}
+	state->align = (align & ~(FONS_ALIGN_RIGHT | FONS_ALIGN_CENTER)) | FONS_ALIGN_LEFT;
+
+	for (i = 0; i < nspans; i++) {
+		state->color = spans[i].color;
+		x = fons__drawText(stash, x, y, spans[i].str, spans[i].end);
+	}
+	fons__flush(stash);
+
+	state->align = align;
+	state->color = color;
+	return x;
+}
+
+FONS_DEF float fonsDrawCodepoints(FONScontext* stash, float x, float y, const unsigned int* codepoints, int ncodepoints)
+{
+	FONSstate* state;
+	FONSfont* font;
+	FONSglyph metrics;
+	FONSglyph* glyph;
+	FONSquad q;
+	short isize, iblur;
+	float scale, width = 0.0f, py = 0.0f;
+	int i, prevGlyphIndex = -1;
+	const float* clip = NULL;
+
+	if (stash == NULL) return x;
+	state = fons__getState(stash);
+	if (state->font < 0 || state->font >= stash->nfonts) return x;
+	font = stash->fonts[state->font];
+	if (font->face == NULL) return x;
+	isize = (short)(state->size*10.0f);
+	iblur = (short)state->blur;
+	scale = fons__tt_getPixelHeightScale(&font->face->font, (float)isize/10.0f);
+
+	// Align horizontally, measured from the glyph metrics.
+	if (!(state->align & FONS_ALIGN_LEFT) && (state->align & (FONS_ALIGN_RIGHT | FONS_ALIGN_CENTER))) {
+		for (i = 0; i < ncodepoints; i++) {
+			glyph = fons__peekGlyph(stash, font, codepoints[i], isize, iblur, &metrics);
+			if (glyph != NULL)
+				fons__getQuad(stash, font, prevGlyphIndex, glyph, scale, state->spacing, &width, &py, &q);
+			prevGlyphIndex = glyph != NULL ? glyph->index : -1;
+		}
+		prevGlyphIndex = -1;
+		x -= (state->align & FONS_ALIGN_RIGHT) ? width : width * 0.5f;
+	}
+	// Align vertically.
+	y += fons__getVertAlign(stash, font, state->align, isize);
+
+	if (state->clipping && stash->capture == NULL) {
+		float extent = (float)isize/10.0f + iblur + 2 + (font->sdfSettings.sdfEnabled ? font->sdfSettings.padding : 0);
+		if (y + extent < state->clip[1] || y - extent > state->clip[3])
+			return x;
+		clip = state->clip;
+	}
+
+	fons__reserveQuads(stash, ncodepoints);
+	x = fons__drawCodepoints(stash, font, state, isize, iblur, scale, x, y, codepoints, ncodepoints, &prevGlyphIndex, clip);
+	fons__flush(stash);
+	return x;
+}
+
+FONS_DEF float fonsDrawGlyphs(FONScontext* stash, float x, float y, const FONSshapedGlyph* glyphs, int nglyphs)
+{
+	FONSstate* state;
+	FONSfont* font;
+	FONSglyph metrics;
+	FONSglyph* glyph;
+	FONSquad q;
+	short isize, iblur;
+	float px, qx, width = 0.0f;
+	int i;
+	const float* clip = NULL;
+
+	if (stash == NULL) return x;
+	state = fons__getState(stash);
+	isize = (short)(state->size*10.0f);
+	iblur = (short)state->blur;
+
+	// Align horizontally.
+	if (!(state->align & FONS_ALIGN_LEFT) && (state->align & (FONS_ALIGN_RIGHT | FONS_ALIGN_CENTER))) {
+		for (i = 0; i < nglyphs; i++)
+			width += glyphs[i].advance;
+		x -= (state->align & FONS_ALIGN_RIGHT) ? width : width * 0.5f;
+	}
+	// Align vertically.
+	if (state->font >= 0 && state->font < stash->nfonts && stash->fonts[state->font]->face != NULL)
+		y += fons__getVertAlign(stash, stash->fonts[state->font], state->align, isize);
+
+	if (state->clipping && stash->capture == NULL)
+		clip = state->clip;
+
+	fons__reserveQuads(stash, nglyphs);
+	for (i = 0; i < nglyphs; i++) {
+		px = x;
+		x += glyphs[i].advance;
+		if (glyphs[i].font < 0 || glyphs[i].font >= stash->nfonts) continue;
+		font = stash->fonts[glyphs[i].font];
+		if (font->face == NULL) continue;
+		if (clip != NULL) {
+			// Only visible glyphs are rasterized.
+			glyph = fons__peekGlyphIndex(font, glyphs[i].index, isize, iblur, &metrics);
+			if (glyph == NULL) continue;
+			qx = px;
+			fons__getQuad(stash, font, -1, glyph, 0.0f, 0.0f, &qx, &y, &q);
+			if (!fons__quadVisible(&q, clip)) continue;
+		}
+		glyph = fons__getGlyphIndex(stash, font, glyphs[i].index, isize, iblur);
+		if (glyph != NULL) {
+			fons__getQuad(stash, font, -1, glyph, 0.0f, 0.0f, &px, &y, &q);
+			fons__emitQuad(stash, &q, state->color);
+		}
+	}
+
+	fons__flush(stash);
+	return x;
+}
+
+FONS_DEF void fonsBeginFrame(FONScontext* stash)
+{
+	if (stash == NULL) return;
+	stash->batching = 1;
+}
+
+FONS_DEF void fonsFlushFrame(FONScontext* stash, void (*beginBatch)(void* uptr, int key), void* uptr)
+{
+	FONSbatch* batch;
+	int i;
+
+	if (stash == NULL) return;
+	// Upload the glyphs added during the frame.
+	fons__flush(stash);
+
+	for (i = 0; i < stash->nbatches; i++) {
+		batch = &stash->batches[i];
+		if (batch->nverts == 0 && batch->ninsts == 0)
+			continue;
+		if (beginBatch != NULL)
+			beginBatch(uptr, batch->key);
+		if (batch->nverts > 0 && stash->params.renderDraw != NULL)
+			stash->params.renderDraw(stash->params.userPtr, batch->verts, batch->nverts);
+		if (batch->ninsts > 0 && stash->params.renderDrawInstanced != NULL)
+			stash->params.renderDrawInstanced(stash->params.userPtr, batch->insts, batch->ninsts);
+		batch->nverts = 0;
+		batch->ninsts = 0;
+	}
+	stash->batching = 0;
+}
+
+static FONStextBuffer* fons__getTextBuffer(FONScontext* stash, int buffer)
+{
+	if (stash == NULL || buffer < 0 || buffer >= stash->ntextBuffers) return NULL;
+	return stash->textBuffers[buffer];
+}
+
+static void fons__freeTextBuffer(FONStextBuffer* buffer)
+{
+	if (buffer == NULL) return;
+	if (buffer->verts) free(buffer->verts);
+	if (buffer->text) free(buffer->text);
+	if (buffer->items) free(buffer->items);
+	free(buffer);
+}
+
+static float fons__layoutTextBufferItem(FONScontext* stash, FONStextBuffer* buffer, FONStextBufferItem* item)
+{
+	float x;
+	const char* str = buffer->text + item->str;
+
+	fonsPushState(stash);
+	*fons__getState(stash) = item->state;
+	stash->capture = buffer;
+	x = fonsDrawText(stash, item->x, item->y, str, str + item->nstr);
+	stash->capture = NULL;
+	fonsPopState(stash);
+
+	return x;
+}
+
+static float fons__layoutTextBuffer(FONScontext* stash, FONStextBuffer* buffer)
+{
+	int i;
+	float x = 0.0f;
+
+	// If the atlas changes during the layout the generation will not match and the text is laid out again later.
+	buffer->generation = stash->atlasGeneration;
+	buffer->nverts = 0;
+	buffer->dirty = 1;
+	for (i = 0; i < buffer->nitems; i++)
+		x = fons__layoutTextBufferItem(stash, buffer, &buffer->items[i]);
+
+	return x;
+}
+
+FONS_DEF int fonsCreateTextBuffer(FONScontext* stash)
+{
+	int i;
+	FONStextBuffer* buffer;
+	if (stash == NULL) return FONS_INVALID;
+
+	buffer = (FONStextBuffer*)malloc(sizeof(FONStextBuffer));
+	if (buffer == NULL) return FONS_INVALID;
+	memset(buffer, 0, sizeof(FONStextBuffer));
+	buffer->generation = stash->atlasGeneration;
+
+	// Reuse a free slot if possible.
+	for (i = 0; i < stash->ntextBuffers; i++) {
+		if (stash->textBuffers[i] == NULL) {
+			stash->textBuffers[i] = buffer;
+			return i;
+		}
+	}
+	stash->textBuffers = (FONStextBuffer**)realloc(stash->textBuffers, sizeof(FONStextBuffer*) * (stash->ntextBuffers+1));
+	if (stash->textBuffers == NULL) {
+		stash->ntextBuffers = 0;
+		fons__freeTextBuffer(buffer);
+		return FONS_INVALID;
+	}
+	stash->textBuffers[stash->ntextBuffers++] = buffer;
+	return stash->ntextBuffers-1;
+}
+
+FONS_DEF void fonsDeleteTextBuffer(FONScontext* stash, int buffer)
+{
+	FONStextBuffer* textBuffer = fons__getTextBuffer(stash, buffer);
+	if (textBuffer == NULL) return;
+
+	if (stash->params.renderDeleteBuffer != NULL)
+		stash->params.renderDeleteBuffer(stash->params.userPtr, buffer);
+	fons__freeTextBuffer(textBuffer);
+	stash->textBuffers[buffer] = NULL;
+}
+
+FONS_DEF void fonsClearTextBuffer(FONScontext* stash, int buffer)
+{
+	FONStextBuffer* textBuffer = fons__getTextBuffer(stash, buffer);
+	if (textBuffer == NULL) return;
+
+	textBuffer->nverts = 0;
+	textBuffer->ntext = 0;
+	textBuffer->nitems = 0;
+	textBuffer->dirty = 1;
+}
+
+FONS_DEF float fonsAppendText(FONScontext* stash, int buffer,
+					 float x, float y,
+					 const char* str, const char* end)
+{
+	FONStextBuffer* textBuffer = fons__getTextBuffer(stash, buffer);
+	FONStextBufferItem* item;
+	int nstr;
+
+	if (textBuffer == NULL) return x;
+
+	if (end == NULL)
+		end = str + strlen(str);
+	nstr = (int)(end - str);
+
+	// Store the string and the state used to draw it.
+	if (textBuffer->ntext+nstr > textBuffer->ctext) {
+		int ctext = textBuffer->ctext == 0 ? 256 : textBuffer->ctext;
+		while (ctext < textBuffer->ntext+nstr)
+			ctext *= 2;
+		textBuffer->text = (char*)realloc(textBuffer->text, ctext);
+		if (textBuffer->text == NULL) {
+			fonsClearTextBuffer(stash, buffer);
+			textBuffer->ctext = 0;
+			return x;
+		}
+		textBuffer->ctext = ctext;
+	}
+	if (textBuffer->nitems+1 > textBuffer->citems) {
+		textBuffer->citems = textBuffer->citems == 0 ? 8 : textBuffer->citems * 2;
+		textBuffer->items = (FONStextBufferItem*)realloc(textBuffer->items, sizeof(FONStextBufferItem) * textBuffer->citems);
+		if (textBuffer->items == NULL) {
+			fonsClearTextBuffer(stash, buffer);
+			textBuffer->citems = 0;
+			return x;
+		}
+	}
+	item = &textBuffer->items[textBuffer->nitems++];
+	item->state = *fons__getState(stash);
+	item->x = x;
+	item->y = y;
+	item->str = textBuffer->ntext;
+	item->nstr = nstr;
+	memcpy(textBuffer->text + textBuffer->ntext, str, nstr);
+	textBuffer->ntext += nstr;
+
+	// Lay out everything again if the atlas has changed since the earlier strings were added.
+	if (textBuffer->generation != stash->atlasGeneration)
+		return fons__layoutTextBuffer(stash, textBuffer);
+
+	return fons__layoutTextBufferItem(stash, textBuffer, item);
+}
+
+FONS_DEF void fonsDrawTextBuffer(FONScontext* stash, int buffer)
+{
+	FONStextBuffer* textBuffer = fons__getTextBuffer(stash, buffer);
+	if (textBuffer == NULL) return;
+
+	if (textBuffer->generation != stash->atlasGeneration)
+		fons__layoutTextBuffer(stash, textBuffer);
+
+	// Make sure the texture is up to date and any pending text is drawn first.
+	fons__flush(stash);
+
+	if (textBuffer->nverts == 0)
+		return;
+
+	if (textBuffer->dirty && stash->params.renderUpdateBuffer != NULL) {
+		if (stash->params.renderUpdateBuffer(stash->params.userPtr, buffer, textBuffer->verts, textBuffer->nverts))
+			textBuffer->dirty = 0;
+	}
+
+	if (!textBuffer->dirty && stash->params.renderDrawBuffer != NULL) {
+		stash->params.renderDrawBuffer(stash->params.userPtr, buffer);
+	} else if (stash->params.renderDraw != NULL) {
+		stash->params.renderDraw(stash->params.userPtr, textBuffer->verts, textBuffer->nverts);
+	}
+}
+
+static unsigned int fons__mulColor(unsigned int a, unsigned int b)
+{
+	unsigned int c = 0;
+	int i;
+	for (i = 0; i < 32; i += 8)
+		c |= ((((a >> i) & 0xff) * ((b >> i) & 0xff) + 127) / 255) << i;
+	return c;
+}
+
+FONS_DEF void fonsDrawTextBufferInstances(FONScontext* stash, int buffer, const FONStextInstance* instances, int ninstances)
 {
-	float rx,ry,xoff,yoff,x0,y0,x1,y1;
+	FONStextBuffer* textBuffer = fons__getTextBuffer(stash, buffer);
+	const FONStextInstance* inst;
+	const FONSvertex* src;
+	FONSvertex* dst;
+	int i, j, k, count;
+	if (textBuffer == NULL || ninstances <= 0) return;
 
-	if (prevGlyphIndex != -1) {
-		float adv = fons__tt_getGlyphKernAdvance(&font->font, prevGlyphIndex, glyph->index) * scale;
-		*x += (int)(adv + spacing + 0.5f);
-	}
+	if (textBuffer->generation != stash->atlasGeneration)
+		fons__layoutTextBuffer(stash, textBuffer);
 
-	// Each glyph has 2px border to allow good interpolation,
-	// one pixel to prevent leaking, and one to allow good interpolation for rendering.
-	// Inset the texture region by one pixel for correct interpolation.
-	xoff = (short)(glyph->xoff+1);
-	yoff = (short)(glyph->yoff+1);
-	x0 = (float)(glyph->x0+1);
-	y0 = (float)(glyph->y0+1);
-	x1 = (float)(glyph->x1-1);
-	y1 = (float)(glyph->y1-1);
+	fons__flush(stash);
 
-	if (stash->params.flags & FONS_ZERO_TOPLEFT) {
-		rx = (float)(int)(*x + xoff);
-		ry = (float)(int)(*y + yoff);
-
-		q->x0 = rx;
-		q->y0 = ry;
-		q->x1 = rx + x1 - x0;
-		q->y1 = ry + y1 - y0;
-
-		q->s0 = x0 * stash->itw;
-		q->t0 = y0 * stash->ith;
-		q->s1 = x1 * stash->itw;
-		q->t1 = y1 * stash->ith;
-	} else {
-		rx = (float)(int)(*x + xoff);
-		ry = (float)(int)(*y - yoff);
+	if (textBuffer->nverts == 0)
+		return;
 
-		q->x0 = rx;
-		q->y0 = ry;
-		q->x1 = rx + x1 - x0;
-		q->y1 = ry - y1 + y0;
+	if (stash->params.renderDrawBufferInstances != NULL) {
+		if (textBuffer->dirty && stash->params.renderUpdateBuffer != NULL) {
+			if (stash->params.renderUpdateBuffer(stash->params.userPtr, buffer, textBuffer->verts, textBuffer->nverts))
+				textBuffer->dirty = 0;
+		}
+		if (!textBuffer->dirty) {
+			stash->params.renderDrawBufferInstances(stash->params.userPtr, buffer, instances, ninstances);
+			return;
+		}
+	}
 
-		q->s0 = x0 * stash->itw;
-		q->t0 = y0 * stash->ith;
-		q->s1 = x1 * stash->itw;
-		q->t1 = y1 * stash->ith;
+	// Copy the vertices for each instance, whole quads at a time.
+	for (i = 0; i < ninstances; i++) {
+		inst = &instances[i];
+		for (j = 0; j < textBuffer->nverts; j += count) {
+			count = fons__mini(textBuffer->nverts - j, FONS_VERTEX_COUNT - FONS_VERTEX_COUNT % 6);
+			fons__reserveVerts(stash, count);
+			src = &textBuffer->verts[j];
+			dst = &stash->verts[stash->nverts];
+			for (k = 0; k < count; k++)
+				fons__setVertex(&dst[k], inst->x + src[k].x * inst->scale, inst->y + src[k].y * inst->scale,
+								src[k].s, src[k].t, fons__mulColor(src[k].color, inst->color));
+			stash->nverts += count;
+		}
 	}
+	fons__flush(stash);
+}
 
-	*x += (int)(glyph->xadv / 10.0f + 0.5f);
+// Returns the cache slot of the word, and 1 if the slot holds the word already.
+static int fons__findWord(FONScontext* stash, FONSstate* state, short isize, const char* str, const char* end,
+						  unsigned int* hash, FONSword** word)
+{
+	int nstr = (int)(end - str);
+	*hash = fons__hashstr(str, end) ^ fons__hashint((unsigned int)(state->font ^ (isize << 8)));
+	*word = &stash->words[*hash & (FONS_WORD_CACHE_SIZE-1)];
+	return (*word)->nstr == nstr && (*word)->hash == *hash && (*word)->font == state->font && (*word)->isize == isize &&
+		(*word)->spacing == state->spacing && memcmp((*word)->str, str, nstr) == 0;
 }
 
-static void fons__flush(FONScontext* stash)
+static float fons__wordAdvance(FONScontext* stash, FONSfont* font, FONSstate* state, short isize, short iblur,
+							   float scale, const char* str, const char* end)
 {
-	// Flush texture
-	if (stash->dirtyRect[0] < stash->dirtyRect[2] && stash->dirtyRect[1] < stash->dirtyRect[3]) {
-		if (stash->params.renderUpdate != NULL)
-			stash->params.renderUpdate(stash->params.userPtr, stash->dirtyRect, stash->texData);
-		// Reset dirty rect
-		stash->dirtyRect[0] = stash->params.width;
-		stash->dirtyRect[1] = stash->params.height;
-		stash->dirtyRect[2] = 0;
-		stash->dirtyRect[3] = 0;
+	int nstr = (int)(end - str);
+	unsigned int hash;
+	FONSword* word;
+
+	if (nstr == 0) return 0.0f;
+	if (nstr > FONS_WORD_MAX_BYTES)
+		return fons__measureAdvance(stash, font, state, isize, iblur, scale, str, end);
+
+	if (fons__findWord(stash, state, isize, str, end, &hash, &word))
+		return word->advance;
+
+	word->hash = hash;
+	word->font = state->font;
+	word->isize = isize;
+	word->spacing = state->spacing;
+	word->advance = fons__measureAdvance(stash, font, state, isize, iblur, scale, str, end);
+	word->nstr = nstr;
+	memcpy(word->str, str, nstr);
+	return word->advance;
+}
+
+static int fons__isBreakAfterCJK(unsigned char c)
+{
+	// Lead bytes of U+3000-U+9FFF: CJK punctuation, kana and ideographs.
+	return c >= 0xe3 && c <= 0xe9;
+}
+
+// Finds the next break opportunity. A segment is a word, the spaces after it and an optional line break. Only
+// ASCII and lead bytes are looked at, UTF-8 continuation bytes never match them.
+static const char* fons__nextBreak(const char* str, const char* end, const char** wordEnd, const char** spaceEnd)
+{
+	const unsigned char* s = (const unsigned char*)str;
+	const unsigned char* e = (const unsigned char*)end;
+
+	if (s != e && fons__isBreakAfterCJK(*s)) {
+		s += e - s < 3 ? e - s : 3;
+	} else {
+		while (s != e && *s != ' ' && *s != '\t' && *s != '\n' && *s != '\r' && !fons__isBreakAfterCJK(*s)) {
+			// Break after a hyphen, but not after a minus sign in front of a word.
+			if (*s++ == '-' && s - 1 != (const unsigned char*)str) break;
+		}
 	}
+	*wordEnd = (const char*)s;
+	while (s != e && (*s == ' ' || *s == '\t'))
+		s++;
+	*spaceEnd = (const char*)s;
+	if (s != e && *s == '\r')
+		s++;
+	if (s != e && *s == '\n')
+		s++;
+	return (const char*)s;
+}
 
-	// Flush triangles
-	if (stash->nverts > 0) {
-		if (stash->params.renderDraw != NULL)
-			stash->params.renderDraw(stash->params.userPtr, stash->verts, stash->tcoords, stash->colors, stash->nverts);
-		stash->nverts = 0;
+// Advance for greeking, from the word cache or estimated from the number of characters.
+static float fons__greekAdvance(FONScontext* stash, FONSfont* font, FONSstate* state, short isize,
+								const char* str, const char* end)
+{
+	unsigned int hash;
+	FONSword* word;
+	int ncps = 0;
+
+	if (str == end) return 0.0f;
+	if (end - str <= FONS_WORD_MAX_BYTES && fons__findWord(stash, state, isize, str, end, &hash, &word))
+		return word->advance;
+
+	for (; str != end; str++) {
+		if (((unsigned char)*str & 0xc0) != 0x80)
+			ncps++;
 	}
+	return (float)ncps * (font->face->greekAdvance * (float)isize/10.0f + state->spacing);
 }
 
-static __inline void fons__vertex(FONScontext* stash, float x, float y, float s, float t, unsigned int c)
+static float fons__drawGreeked(FONScontext* stash, FONSfont* font, FONSstate* state, short isize,
+							   float x, float y, const char* str, const char* end, const float* clip)
 {
-	stash->verts[stash->nverts*2+0] = x;
-	stash->verts[stash->nverts*2+1] = y;
-	stash->tcoords[stash->nverts*2+0] = s;
-	stash->tcoords[stash->nverts*2+1] = t;
-	stash->colors[stash->nverts] = c;
-	stash->nverts++;
+	const char* wordEnd;
+	const char* spaceEnd;
+	const char* next;
+	const char* s;
+	float width = 0.0f, wordWidth, h;
+	FONSquad q;
+
+	if (!(state->align & FONS_ALIGN_LEFT) && (state->align & (FONS_ALIGN_RIGHT | FONS_ALIGN_CENTER))) {
+		for (s = str; s != end; s = next) {
+			next = fons__nextBreak(s, end, &wordEnd, &spaceEnd);
+			width += fons__greekAdvance(stash, font, state, isize, s, spaceEnd);
+		}
+		x -= (state->align & FONS_ALIGN_RIGHT) ? width : width * 0.5f;
+	}
+	y += fons__getVertAlign(stash, font, state->align, isize);
+
+	// Bars of about the x-height on the baseline, textured from the white rect in the corner of the atlas.
+	h = font->face->ascender * (float)isize/10.0f * 0.6f;
+	q.y0 = (stash->params.flags & FONS_ZERO_TOPLEFT) ? y - h : y + h;
+	q.y1 = y;
+	q.s0 = q.s1 = stash->itw;
+	q.t0 = q.t1 = stash->ith;
+
+	for (; str != end; str = next) {
+		next = fons__nextBreak(str, end, &wordEnd, &spaceEnd);
+		wordWidth = fons__greekAdvance(stash, font, state, isize, str, wordEnd);
+		q.x0 = x;
+		q.x1 = x + wordWidth;
+		if (state->greekMode == FONS_GREEK_BARS && wordWidth > 0.0f && (clip == NULL || fons__quadVisible(&q, clip)))
+			fons__emitQuad(stash, &q, state->color);
+		x += fons__greekAdvance(stash, font, state, isize, str, spaceEnd);
+	}
+	return x;
 }
 
-static float fons__getVertAlign(FONScontext* stash, FONSfont* font, int align, short isize)
+// Breaks one row starting from 'str', returns 0 at the end of the text. The row width is the sum of the word
+// advances, kerning across break opportunities is ignored.
+static int fons__breakRow(FONScontext* stash, FONSfont* font, FONSstate* state, short isize, short iblur,
+						  float scale, const char* str, const char* end, float breakRowWidth, FONStextRow* row)
 {
-	if (stash->params.flags & FONS_ZERO_TOPLEFT) {
-		if (align & FONS_ALIGN_TOP) {
-			return font->ascender * (float)isize/10.0f;
-		} else if (align & FONS_ALIGN_MIDDLE) {
-			return (font->ascender + font->descender) / 2.0f * (float)isize/10.0f;
-		} else if (align & FONS_ALIGN_BASELINE) {
-			return 0.0f;
-		} else if (align & FONS_ALIGN_BOTTOM) {
-			return font->descender * (float)isize/10.0f;
+	const char* wordEnd;
+	const char* spaceEnd;
+	const char* next;
+	float x = 0.0f, wordWidth;
+	int nwords = 0;
+
+	if (str == end) return 0;
+
+	row->start = row->end = str;
+	row->next = end;
+	row->width = 0.0f;
+	while (str != end) {
+		next = fons__nextBreak(str, end, &wordEnd, &spaceEnd);
+		wordWidth = fons__wordAdvance(stash, font, state, isize, iblur, scale, str, wordEnd);
+		if (nwords > 0 && x + wordWidth > breakRowWidth) {
+			row->next = str;
+			return 1;
 		}
-	} else {
-		if (align & FONS_ALIGN_TOP) {
-			return -font->ascender * (float)isize/10.0f;
-		} else if (align & FONS_ALIGN_MIDDLE) {
-			return -(font->ascender + font->descender) / 2.0f * (float)isize/10.0f;
-		} else if (align & FONS_ALIGN_BASELINE) {
-			return 0.0f;
-		} else if (align & FONS_ALIGN_BOTTOM) {
-			return -font->descender * (float)isize/10.0f;
+		row->end = wordEnd;
+		row->width = x + wordWidth;
+		x += wordWidth + fons__wordAdvance(stash, font, state, isize, iblur, scale, wordEnd, spaceEnd);
+		nwords++;
+		str = next;
+		if (next != spaceEnd) {
+			row->next = next;
+			return 1;
 		}
 	}
-	return 0.0;
+	return 1;
 }
 
-FONS_DEF float fonsDrawText(FONScontext* stash,
-				   float x, float y,
-				   const char* str, const char* end)
+FONS_DEF int fonsTextBreakLines(FONScontext* stash, const char* str, const char* end,
+								float breakRowWidth, FONStextRow* rows, int maxRows)
 {
 	FONSstate* state = fons__getState(stash);
-	unsigned int codepoint;
-	unsigned int utf8state = 0;
-	FONSglyph* glyph = NULL;
-	FONSquad q;
-	int prevGlyphIndex = -1;
 	short isize = (short)(state->size*10.0f);
 	short iblur = (short)state->blur;
 	float scale;
 	FONSfont* font;
-	float width;
+	int nrows = 0;
 
-	if (stash == NULL) return x;
-	if (state->font < 0 || state->font >= stash->nfonts) return x;
+	if (stash == NULL) return 0;
+	if (state->font < 0 || state->font >= stash->nfonts) return 0;
 	font = stash->fonts[state->font];
-	if (font->data == NULL) return x;
+	if (font->face == NULL) return 0;
 
-	scale = fons__tt_getPixelHeightScale(&font->font, (float)isize/10.0f);
+	scale = fons__tt_getPixelHeightScale(&font->face->font, (float)isize/10.0f);
 
 	if (end == NULL)
 		end = str + strlen(str);
 
-	// Align horizontally
-	if (state->align & FONS_ALIGN_LEFT) {
-		// empty
-	} else if (state->align & FONS_ALIGN_RIGHT) {
-		width = fonsTextBounds(stash, x,y, str, end, NULL);
-		x -= width;
-	} else if (state->align & FONS_ALIGN_CENTER) {
-		width = fonsTextBounds(stash, x,y, str, end, NULL);
-		x -= width * 0.5f;
+	while (nrows < maxRows && fons__breakRow(stash, font, state, isize, iblur, scale, str, end, breakRowWidth, &rows[nrows])) {
+		str = rows[nrows].next;
+		nrows++;
 	}
-	// Align vertically.
-	y += fons__getVertAlign(stash, font, state->align, isize);
+	return nrows;
+}
 
-	for (; str != end; ++str) {
-		if (fons__decutf8(&utf8state, &codepoint, *(const unsigned char*)str))
-			continue;
-		glyph = fons__getGlyph(stash, font, codepoint, isize, iblur);
-		if (glyph != NULL) {
-			fons__getQuad(stash, font, prevGlyphIndex, glyph, scale, state->spacing, &x, &y, &q);
+FONS_DEF int fonsTextGlyphPositions(FONScontext* stash, float x, float y, const char* str, const char* end,
+									FONSglyphPosition* positions, int maxPositions)
+{
+	FONStextIter iter;
+	FONSglyph metrics;
+	FONSglyph* glyph;
+	FONSquad q;
+	unsigned int codepoint;
+	int npos = 0;
+
+	if (stash == NULL) return 0;
+	if (!fonsTextIterInit(stash, &iter, x, y, str, end)) return 0;
+
+	// Like fonsTextIterNext() but placed from the glyph metrics, the glyphs are not rasterized.
+	while (npos < maxPositions && iter.next != iter.end) {
+		iter.str = iter.next;
+		// Missing glyphs get an empty quad.
+		q.x0 = q.x1 = iter.nextx;
+		if (fons__decodeUtf8(&iter.utf8state, &iter.codepoint, &iter.next, iter.end, &codepoint, 1) == 1) {
+			iter.x = iter.nextx;
+			iter.y = iter.nexty;
+			glyph = fons__peekGlyph(stash, iter.font, codepoint, iter.isize, iter.iblur, &metrics);
+			if (glyph != NULL)
+				fons__getQuad(stash, iter.font, iter.prevGlyphIndex, glyph, iter.scale, iter.spacing, &iter.nextx, &iter.nexty, &q);
+			iter.prevGlyphIndex = glyph != NULL ? glyph->index : -1;
+		}
+		positions[npos].str = iter.str;
+		positions[npos].x = iter.x;
+		positions[npos].minx = q.x0 < q.x1 ? q.x0 : q.x1;
+		positions[npos].maxx = q.x0 < q.x1 ? q.x1 : q.x0;
+		npos++;
+	}
+	return npos;
+}
+
+static FONSparagraph* fons__getParagraph(FONScontext* stash, int para)
+{
+	if (stash == NULL || para < 0 || para >= stash->nparagraphs) return NULL;
+	return stash->paragraphs[para];
+}
+
+static void fons__freeParagraph(FONSparagraph* p)
+{
+	if (p == NULL) return;
+	if (p->text[0]) free(p->text[0]);
+	if (p->text[1]) free(p->text[1]);
+	if (p->rows) free(p->rows);
+	if (p->scratch) free(p->scratch);
+	free(p);
+}
+
+static int fons__growRows(FONStextRow** rows, int* crows, int nrows)
+{
+	int c = *crows == 0 ? 16 : *crows;
+	if (nrows <= *crows) return 1;
+	while (c < nrows)
+		c *= 2;
+	*rows = (FONStextRow*)realloc(*rows, sizeof(FONStextRow) * c);
+	if (*rows == NULL) {
+		*crows = 0;
+		return 0;
+	}
+	*crows = c;
+	return 1;
+}
+
+static __inline void fons__moveRow(FONStextRow* row, const char* from, char* to, int delta)
+{
+	row->start = to + (row->start - from) + delta;
+	row->end = to + (row->end - from) + delta;
+	row->next = to + (row->next - from) + delta;
+}
+
+FONS_DEF int fonsCreateParagraph(FONScontext* stash)
+{
+	int i;
+	FONSparagraph* p;
+	if (stash == NULL) return FONS_INVALID;
+
+	p = (FONSparagraph*)malloc(sizeof(FONSparagraph));
+	if (p == NULL) return FONS_INVALID;
+	memset(p, 0, sizeof(FONSparagraph));
+
+	// Reuse a free slot if possible.
+	for (i = 0; i < stash->nparagraphs; i++) {
+		if (stash->paragraphs[i] == NULL) {
+			stash->paragraphs[i] = p;
+			return i;
+		}
+	}
+	stash->paragraphs = (FONSparagraph**)realloc(stash->paragraphs, sizeof(FONSparagraph*) * (stash->nparagraphs+1));
+	if (stash->paragraphs == NULL) {
+		stash->nparagraphs = 0;
+		fons__freeParagraph(p);
+		return FONS_INVALID;
+	}
+	stash->paragraphs[stash->nparagraphs++] = p;
+	return stash->nparagraphs-1;
+}
+
+FONS_DEF void fonsDeleteParagraph(FONScontext* stash, int para)
+{
+	FONSparagraph* p = fons__getParagraph(stash, para);
+	if (p == NULL) return;
+	fons__freeParagraph(p);
+	stash->paragraphs[para] = NULL;
+}
 
-			if (stash->nverts+6 > FONS_VERTEX_COUNT)
-				fons__flush(stash);
+FONS_DEF int fonsLayoutParagraph(FONScontext* stash, int para, const char* str, const char* end,
+								 float breakRowWidth, const FONStextRow** rows)
+{
+	FONSparagraph* p = fons__getParagraph(stash, para);
+	FONSstate* state;
+	FONSfont* font;
+	FONStextRow row;
+	short isize, iblur;
+	float scale;
+	const char* oldText;
+	char* text;
+	int i, n, pre, suf, delta, first, k, nnew, ntail, o, restyle;
+
+	if (rows) *rows = NULL;
+	if (p == NULL) return 0;
+	state = fons__getState(stash);
+	isize = (short)(state->size*10.0f);
+	iblur = (short)state->blur;
+	if (state->font < 0 || state->font >= stash->nfonts) return 0;
+	font = stash->fonts[state->font];
+	if (font->face == NULL) return 0;
 
-			fons__vertex(stash, q.x0, q.y0, q.s0, q.t0, state->color);
-			fons__vertex(stash, q.x1, q.y1, q.s1, q.t1, state->color);
-			fons__vertex(stash, q.x1, q.y0, q.s1, q.t0, state->color);
+	scale = fons__tt_getPixelHeightScale(&font->face->font, (float)isize/10.0f);
 
-			fons__vertex(stash, q.x0, q.y0, q.s0, q.t0, state->color);
-			fons__vertex(stash, q.x0, q.y1, q.s0, q.t1, state->color);
-			fons__vertex(stash, q.x1, q.y1, q.s1, q.t1, state->color);
+	if (end == NULL)
+		end = str + strlen(str);
+	n = (int)(end - str);
+	oldText = p->text[p->cur];
+
+	restyle = !p->valid || p->breakRowWidth != breakRowWidth || p->font != state->font ||
+		p->isize != isize || p->spacing != state->spacing;
+
+	// Find the changed part of the text.
+	pre = 0;
+	while (pre < n && pre < p->ntext && str[pre] == oldText[pre])
+		pre++;
+	if (!restyle && pre == n && n == p->ntext) {
+		if (rows) *rows = p->rows;
+		return p->nrows;
+	}
+	suf = 0;
+	while (suf < n - pre && suf < p->ntext - pre && str[n-1-suf] == oldText[p->ntext-1-suf])
+		suf++;
+	delta = n - p->ntext;
+
+	// Start from the row before the change, the first word of the changed row may fit on it now.
+	first = 0;
+	if (!restyle) {
+		while (first < p->nrows && p->rows[first].next - oldText <= pre)
+			first++;
+		if (first > 0)
+			first--;
+	}
+
+	// Copy the text to the other buffer, the old rows keep pointing to the old text until they are moved.
+	o = p->cur ^ 1;
+	if (p->text[o] == NULL || n > p->ctext[o]) {
+		int c = p->ctext[o] == 0 ? 256 : p->ctext[o];
+		while (c < n)
+			c *= 2;
+		if (p->text[o]) free(p->text[o]);
+		p->text[o] = (char*)malloc(c);
+		p->ctext[o] = p->text[o] != NULL ? c : 0;
+		if (p->text[o] == NULL) goto error;
+	}
+	text = p->text[o];
+	memcpy(text, str, n);
+	end = text + n;
+
+	for (i = 0; i < first; i++)
+		fons__moveRow(&p->rows[i], oldText, text, 0);
+	str = first > 0 ? p->rows[first-1].next : text;
+
+	// Once a row starts after the changed text where an old row started, the rest of the old rows are still valid.
+	k = first;
+	nnew = 0;
+	ntail = 0;
+	while (fons__breakRow(stash, font, state, isize, iblur, scale, str, end, breakRowWidth, &row)) {
+		if (!fons__growRows(&p->scratch, &p->cscratch, nnew+1)) goto error;
+		p->scratch[nnew++] = row;
+		str = row.next;
+		if (!restyle && str - text >= n - suf) {
+			int old = (int)(str - text) - delta;
+			while (k < p->nrows && p->rows[k].start - oldText < old)
+				k++;
+			if (k < p->nrows && p->rows[k].start - oldText == old) {
+				ntail = p->nrows - k;
+				break;
+			}
 		}
-		prevGlyphIndex = glyph != NULL ? glyph->index : -1;
+	}
+
+	if (!fons__growRows(&p->rows, &p->crows, first + nnew + ntail)) goto error;
+	if (ntail > 0) {
+		memmove(&p->rows[first + nnew], &p->rows[k], sizeof(FONStextRow) * ntail);
+		for (i = first + nnew; i < first + nnew + ntail; i++)
+			fons__moveRow(&p->rows[i], oldText, text, delta);
+	}
+	if (nnew > 0)
+		memcpy(&p->rows[first], p->scratch, sizeof(FONStextRow) * nnew);
+	p->nrows = first + nnew + ntail;
+
+	p->cur = o;
+	p->ntext = n;
+	p->valid = 1;
+	p->font = state->font;
+	p->isize = isize;
+	p->spacing = state->spacing;
+	p->breakRowWidth = breakRowWidth;
+
+	if (rows) *rows = p->rows;
+	return p->nrows;
+
+error:
+	p->nrows = 0;
+	p->ntext = 0;
+	p->valid = 0;
+	return 0;
+}
+
+FONS_DEF float fonsDrawParagraph(FONScontext* stash, int para, float x, float y, float lineHeight)
+{
+	FONSparagraph* p = fons__getParagraph(stash, para);
+	int i;
+
+	if (p == NULL) return y;
+
+	for (i = 0; i < p->nrows; i++) {
+		fons__drawText(stash, x, y, p->rows[i].start, p->rows[i].end);
+		y += lineHeight;
 	}
 	fons__flush(stash);
 
-	return x;
+	return y;
 }
 
 FONS_DEF int fonsTextIterInit(FONScontext* stash, FONStextIter* iter,
@@ -1448,11 +4039,11 @@ FONS_DEF int fonsTextIterInit(FONScontext* stash, FONStextIter* iter,
 	if (stash == NULL) return 0;
 	if (state->font < 0 || state->font >= stash->nfonts) return 0;
 	iter->font = stash->fonts[state->font];
-	if (iter->font->data == NULL) return 0;
+	if (iter->font->face == NULL) return 0;
 
 	iter->isize = (short)(state->size*10.0f);
 	iter->iblur = (short)state->blur;
-	iter->scale = fons__tt_getPixelHeightScale(&iter->font->font, (float)iter->isize/10.0f);
+	iter->scale = fons__tt_getPixelHeightScale(&iter->font->face->font, (float)iter->isize/10.0f);
 
 	// Align horizontally
 	if (state->align & FONS_ALIGN_LEFT) {
@@ -1486,15 +4077,14 @@ FONS_DEF int fonsTextIterNext(FONScontext* stash, FONStextIter* iter, FONSquad*
 {
 	FONSglyph* glyph = NULL;
 	const char* str = iter->next;
+	unsigned int codepoint;
 	iter->str = iter->next;
 
 	if (str == iter->end)
 		return 0;
 
-	for (; str != iter->end; str++) {
-		if (fons__decutf8(&iter->utf8state, &iter->codepoint, *(const unsigned char*)str))
-			continue;
-		str++;
+	if (fons__decodeUtf8(&iter->utf8state, &iter->codepoint, &str, iter->end, &codepoint, 1) == 1) {
+		iter->codepoint = codepoint;
 		// Get glyph and quad
 		iter->x = iter->nextx;
 		iter->y = iter->nexty;
@@ -1502,7 +4092,6 @@ FONS_DEF int fonsTextIterNext(FONScontext* stash, FONStextIter* iter, FONSquad*
 		if (glyph != NULL)
 			fons__getQuad(stash, iter->font, iter->prevGlyphIndex, glyph, iter->scale, iter->spacing, &iter->nextx, &iter->nexty, quad);
 		iter->prevGlyphIndex = glyph != NULL ? glyph->index : -1;
-		break;
 	}
 	iter->next = str;
 
@@ -1517,8 +4106,7 @@ FONS_DEF void fonsDrawDebug(FONScontext* stash, float x, float y)
 	float u = w == 0 ? 0 : (1.0f / w);
 	float v = h == 0 ? 0 : (1.0f / h);
 
-	if (stash->nverts+6+6 > FONS_VERTEX_COUNT)
-		fons__flush(stash);
+	fons__reserveVerts(stash, 6+6);
 
 	// Draw background
 	fons__vertex(stash, x+0, y+0, u, v, 0x0fffffff);
@@ -1542,8 +4130,7 @@ FONS_DEF void fonsDrawDebug(FONScontext* stash, float x, float y)
 	for (i = 0; i < stash->atlas->nnodes; i++) {
 		FONSatlasNode* n = &stash->atlas->nodes[i];
 
-		if (stash->nverts+6 > FONS_VERTEX_COUNT)
-			fons__flush(stash);
+		fons__reserveVerts(stash, 6);
 
 		fons__vertex(stash, x+n->x+0, y+n->y+0, u, v, 0xc00000ff);
 		fons__vertex(stash, x+n->x+n->width, y+n->y+1, u, v, 0xc00000ff);
@@ -1557,30 +4144,19 @@ FONS_DEF void fonsDrawDebug(FONScontext* stash, float x, float y)
 	fons__flush(stash);
 }
 
-FONS_DEF float fonsTextBounds(FONScontext* stash,
-					 float x, float y, 
-					 const char* str, const char* end,
-					 float* bounds)
+static float fons__textBounds(FONScontext* stash, FONSfont* font, FONSstate* state, short isize, short iblur,
+							  float scale, float x, float y, const char* str, const char* end, float* bounds)
 {
-	FONSstate* state = fons__getState(stash);
 	unsigned int codepoint;
 	unsigned int utf8state = 0;
 	FONSquad q;
+	FONSglyph metrics;
 	FONSglyph* glyph = NULL;
 	int prevGlyphIndex = -1;
-	short isize = (short)(state->size*10.0f);
-	short iblur = (short)state->blur;
-	float scale;
-	FONSfont* font;
 	float startx, advance;
 	float minx, miny, maxx, maxy;
-
-	if (stash == NULL) return 0;
-	if (state->font < 0 || state->font >= stash->nfonts) return 0;
-	font = stash->fonts[state->font];
-	if (font->data == NULL) return 0;
-
-	scale = fons__tt_getPixelHeightScale(&font->font, (float)isize/10.0f);
+	unsigned int cps[FONS_DECODE_CHUNK];
+	int i, ncps;
 
 	// Align vertically.
 	y += fons__getVertAlign(stash, font, state->align, isize);
@@ -1592,23 +4168,24 @@ FONS_DEF float fonsTextBounds(FONScontext* stash,
 	if (end == NULL)
 		end = str + strlen(str);
 
-	for (; str != end; ++str) {
-		if (fons__decutf8(&utf8state, &codepoint, *(const unsigned char*)str))
-			continue;
-		glyph = fons__getGlyph(stash, font, codepoint, isize, iblur);
-		if (glyph != NULL) {
-			fons__getQuad(stash, font, prevGlyphIndex, glyph, scale, state->spacing, &x, &y, &q);
-			if (q.x0 < minx) minx = q.x0;
-			if (q.x1 > maxx) maxx = q.x1;
-			if (stash->params.flags & FONS_ZERO_TOPLEFT) {
-				if (q.y0 < miny) miny = q.y0;
-				if (q.y1 > maxy) maxy = q.y1;
-			} else {
-				if (q.y1 < miny) miny = q.y1;
-				if (q.y0 > maxy) maxy = q.y0;
+	while (str != end) {
+		ncps = fons__decodeUtf8(&utf8state, &codepoint, &str, end, cps, FONS_DECODE_CHUNK);
+		for (i = 0; i < ncps; i++) {
+			glyph = fons__peekGlyph(stash, font, cps[i], isize, iblur, &metrics);
+			if (glyph != NULL) {
+				fons__getQuad(stash, font, prevGlyphIndex, glyph, scale, state->spacing, &x, &y, &q);
+				if (q.x0 < minx) minx = q.x0;
+				if (q.x1 > maxx) maxx = q.x1;
+				if (stash->params.flags & FONS_ZERO_TOPLEFT) {
+					if (q.y0 < miny) miny = q.y0;
+					if (q.y1 > maxy) maxy = q.y1;
+				} else {
+					if (q.y1 < miny) miny = q.y1;
+					if (q.y0 > maxy) maxy = q.y0;
+				}
 			}
+			prevGlyphIndex = glyph != NULL ? glyph->index : -1;
 		}
-		prevGlyphIndex = glyph != NULL ? glyph->index : -1;
 	}
 
 	advance = x - startx;
@@ -1634,6 +4211,69 @@ FONS_DEF float fonsTextBounds(FONScontext* stash,
 	return advance;
 }
 
+FONS_DEF float fonsTextBounds(FONScontext* stash,
+					 float x, float y,
+					 const char* str, const char* end,
+					 float* bounds)
+{
+	FONSstate* state;
+	short isize, iblur;
+	float scale;
+	FONSfont* font;
+
+	if (stash == NULL) return 0;
+	state = fons__getState(stash);
+	if (state->font < 0 || state->font >= stash->nfonts) return 0;
+	font = stash->fonts[state->font];
+	if (font->face == NULL) return 0;
+
+	isize = (short)(state->size*10.0f);
+	iblur = (short)state->blur;
+	scale = fons__tt_getPixelHeightScale(&font->face->font, (float)isize/10.0f);
+	return fons__textBounds(stash, font, state, isize, iblur, scale, x, y, str, end, bounds);
+}
+
+FONS_DEF float fonsTextBoundsStyled(FONScontext* stash, int style, float x, float y, const char* str, const char* end,
+									float* bounds)
+{
+	FONSstyle* s = fons__getStyle(stash, style);
+	if (s == NULL) return 0;
+	return fons__textBounds(stash, s->font, &s->state, s->isize, s->iblur, s->scale, x, y, str, end, bounds);
+}
+
+FONS_DEF void fonsTextBoundsMany(FONScontext* stash, const char* const* strings, const char* const* ends, int nstrings,
+								 float* advances, float* bounds)
+{
+	FONSstate* state;
+	short isize, iblur;
+	float scale;
+	FONSfont* font;
+	const char* end;
+	int i;
+
+	if (stash == NULL) return;
+	state = fons__getState(stash);
+	if (state->font < 0 || state->font >= stash->nfonts || stash->fonts[state->font]->face == NULL) {
+		memset(advances, 0, sizeof(float) * nstrings);
+		if (bounds != NULL)
+			memset(bounds, 0, sizeof(float) * 4 * nstrings);
+		return;
+	}
+	font = stash->fonts[state->font];
+	isize = (short)(state->size*10.0f);
+	iblur = (short)state->blur;
+	scale = fons__tt_getPixelHeightScale(&font->face->font, (float)isize/10.0f);
+
+	for (i = 0; i < nstrings; i++) {
+		end = ends != NULL && ends[i] != NULL ? ends[i] : strings[i] + strlen(strings[i]);
+		// Without bounds, short strings come from the word cache.
+		if (bounds == NULL)
+			advances[i] = fons__wordAdvance(stash, font, state, isize, iblur, scale, strings[i], end);
+		else
+			advances[i] = fons__textBounds(stash, font, state, isize, iblur, scale, 0, 0, strings[i], end, &bounds[i*4]);
+	}
+}
+
 FONS_DEF void fonsVertMetrics(FONScontext* stash,
 					 float* ascender, float* descender, float* lineh)
 {
@@ -1645,14 +4285,38 @@ FONS_DEF void fonsVertMetrics(FONScontext* stash,
 	if (state->font < 0 || state->font >= stash->nfonts) return;
 	font = stash->fonts[state->font];
 	isize = (short)(state->size*10.0f);
-	if (font->data == NULL) return;
+	if (font->face == NULL) return;
+
+	if (ascender)
+		*ascender = font->face->ascender*isize/10.0f;
+	if (descender)
+		*descender = font->face->descender*isize/10.0f;
+	if (lineh)
+		*lineh = font->face->lineh*isize/10.0f;
+}
+
+FONS_DEF void fonsVertMetricsStyled(FONScontext* stash, int style, float* ascender, float* descender, float* lineh)
+{
+	FONSstyle* s = fons__getStyle(stash, style);
+	if (s == NULL) return;
 
 	if (ascender)
-		*ascender = font->ascender*isize/10.0f;
+		*ascender = s->font->face->ascender*s->isize/10.0f;
 	if (descender)
-		*descender = font->descender*isize/10.0f;
+		*descender = s->font->face->descender*s->isize/10.0f;
 	if (lineh)
-		*lineh = font->lineh*isize/10.0f;
+		*lineh = s->font->face->lineh*s->isize/10.0f;
+}
+
+FONS_DEF float fonsGetRasterSize(FONScontext* stash)
+{
+	FONSstate* state = fons__getState(stash);
+	short isize;
+
+	if (stash == NULL) return 0.0f;
+	if (state->font < 0 || state->font >= stash->nfonts) return 0.0f;
+	isize = (short)(state->size*10.0f);
+	return fons__rasterSize(stash, stash->fonts[state->font], isize, 0) / 10.0f;
 }
 
 FONS_DEF void fonsLineBounds(FONScontext* stash, float y, float* miny, float* maxy)
@@ -1665,16 +4329,16 @@ FONS_DEF void fonsLineBounds(FONScontext* stash, float y, float* miny, float* ma
 	if (state->font < 0 || state->font >= stash->nfonts) return;
 	font = stash->fonts[state->font];
 	isize = (short)(state->size*10.0f);
-	if (font->data == NULL) return;
+	if (font->face == NULL) return;
 
 	y += fons__getVertAlign(stash, font, state->align, isize);
 
 	if (stash->params.flags & FONS_ZERO_TOPLEFT) {
-		*miny = y - font->ascender * (float)isize/10.0f;
-		*maxy = *miny + font->lineh*isize/10.0f;
+		*miny = y - font->face->ascender * (float)isize/10.0f;
+		*maxy = *miny + font->face->lineh*isize/10.0f;
 	} else {
-		*maxy = y + font->descender * (float)isize/10.0f;
-		*miny = *maxy - font->lineh*isize/10.0f;
+		*maxy = y + font->face->descender * (float)isize/10.0f;
+		*miny = *maxy - font->face->lineh*isize/10.0f;
 	}
 }
 
@@ -1709,16 +4373,36 @@ FONS_DEF void fonsDeleteInternal(FONScontext* stash)
 	int i;
 	if (stash == NULL) return;
 
+	for (i = 0; i < stash->ntextBuffers; ++i)
+		fonsDeleteTextBuffer(stash, i);
+	if (stash->textBuffers) free(stash->textBuffers);
+
+	for (i = 0; i < stash->nparagraphs; ++i)
+		fonsDeleteParagraph(stash, i);
+	if (stash->paragraphs) free(stash->paragraphs);
+
+	for (i = 0; i < stash->nstyles; ++i)
+		fonsDeleteStyle(stash, i);
+	if (stash->styles) free(stash->styles);
+
 	if (stash->params.renderDelete)
 		stash->params.renderDelete(stash->params.userPtr);
 
 	for (i = 0; i < stash->nfonts; ++i)
 		fons__freeFont(stash->fonts[i]);
+	for (i = 0; i < stash->nfaces; ++i)
+		fons__freeFace(stash->faces[i]);
+
+	fons__freeRuns(stash);
+	fons__freeBatches(stash);
 
 	if (stash->atlas) fons__deleteAtlas(stash->atlas);
 	if (stash->fonts) free(stash->fonts);
+	if (stash->faces) free(stash->faces);
 	if (stash->texData) free(stash->texData);
 	if (stash->scratch) free(stash->scratch);
+	if (stash->arena) free(stash->arena);
+	if (stash->insts) free(stash->insts);
 	free(stash);
 }
 
@@ -1784,11 +4468,33 @@ FONS_DEF int fonsExpandAtlas(FONScontext* stash, int width, int height)
 	stash->dirtyRect[2] = stash->params.width;
 	stash->dirtyRect[3] = maxy;
 
+	// Batched vertices have texture coordinates for the old size, the glyphs stay in place. The tag of hybrid
+	// bitmaps is kept as it is, and in texels it is re-encoded with the new width.
+	for (i = 0; i < stash->nbatches; i++) {
+		FONSbatch* batch = &stash->batches[i];
+		int j, tag = (int)FONS_HYBRID_BITMAP_TAG;
+		for (j = 0; j < batch->nverts; j++) {
+			float tagged = batch->verts[j].s > 1.5f ? FONS_HYBRID_BITMAP_TAG : 0.0f;
+			batch->verts[j].s = tagged + (batch->verts[j].s - tagged) * stash->params.width / width;
+			batch->verts[j].t *= (float)stash->params.height / height;
+		}
+		for (j = 0; j < batch->ninsts; j++) {
+			FONSinstance* inst = &batch->insts[j];
+			if (inst->s0 > stash->params.width * 3 / 2) {
+				inst->s0 = (unsigned short)(inst->s0 + (width - stash->params.width) * tag);
+				inst->s1 = (unsigned short)(inst->s1 + (width - stash->params.width) * tag);
+			}
+		}
+	}
+
 	stash->params.width = width;
 	stash->params.height = height;
 	stash->itw = 1.0f/stash->params.width;
 	stash->ith = 1.0f/stash->params.height;
 
+	// Cached runs have texture coordinates for the old size.
+	stash->atlasGeneration++;
+
 	return 1;
 }
 
@@ -1833,6 +4539,15 @@ FONS_DEF int fonsResetAtlas(FONScontext* stash, int width, int height)
 	stash->itw = 1.0f/stash->params.width;
 	stash->ith = 1.0f/stash->params.height;
 
+	// Invalidate cached runs.
+	stash->atlasGeneration++;
+
+	// Text batched so far refers to the old glyphs and is dropped.
+	for (i = 0; i < stash->nbatches; i++) {
+		stash->batches[i].nverts = 0;
+		stash->batches[i].ninsts = 0;
+	}
+
 	// Add white rect at 0,0 for debug drawing.
 	fons__addWhiteRect(stash, 2,2);
 
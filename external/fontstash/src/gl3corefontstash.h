@@ -24,6 +24,12 @@ extern "C" {
 
 FONS_DEF FONScontext* glfonsCreate(int width, int height, int flags);
 FONS_DEF void glfonsDelete(FONScontext* ctx);
+// The text shaders read the atlas size from uniforms set by the renderer, 'texCoordScale' (text.v.glsl) and
+// 'atlasSize' (text_instanced.v.glsl).
+// Register each program that draws text once after linking it, its uniforms are then set right away and again
+// whenever the atlas is resized, never per draw. Registering a program again is harmless, deleted programs are
+// dropped when the atlas is resized. Returns 0 if GLFONS_MAX_PROGRAMS programs are already registered.
+FONS_DEF int glfonsRegisterProgram(FONScontext* ctx, unsigned int program);
 
 /*FONS_DEF */unsigned int glfonsRGBA(unsigned char r, unsigned char g, unsigned char b, unsigned char a);
 
@@ -48,16 +54,255 @@ FONS_DEF void glfonsDelete(FONScontext* ctx);
 #	define GLFONS_COLOR_ATTRIB 2
 #endif
 
+// Attributes of the instanced shader (text_instanced.v.glsl). Instancing is not available on ES2.
+#ifndef GLFONS_INSTANCE_POSITION_ATTRIB
+#	define GLFONS_INSTANCE_POSITION_ATTRIB 0
+#endif
+
+#ifndef GLFONS_INSTANCE_SIZE_ATTRIB
+#	define GLFONS_INSTANCE_SIZE_ATTRIB 1
+#endif
+
+#ifndef GLFONS_INSTANCE_TCOORD_ATTRIB
+#	define GLFONS_INSTANCE_TCOORD_ATTRIB 2
+#endif
+
+#ifndef GLFONS_INSTANCE_COLOR_ATTRIB
+#	define GLFONS_INSTANCE_COLOR_ATTRIB 3
+#endif
+
+// Per instance attributes of the text buffer instancing shader (text_buffer_instanced.v.glsl), the vertex
+// attributes are the same as in the normal shader.
+#ifndef GLFONS_TEXT_INSTANCE_TRANSFORM_ATTRIB
+#	define GLFONS_TEXT_INSTANCE_TRANSFORM_ATTRIB 3
+#endif
+
+#ifndef GLFONS_TEXT_INSTANCE_COLOR_ATTRIB
+#	define GLFONS_TEXT_INSTANCE_COLOR_ATTRIB 4
+#endif
+
+// Streamed vertices are written to a ring buffer split into segments. A draw never crosses a segment boundary.
+#ifndef GLFONS_RING_SEGMENT_VERTS
+#	define GLFONS_RING_SEGMENT_VERTS 4096
+#endif
+#ifndef GLFONS_RING_SEGMENTS
+#	define GLFONS_RING_SEGMENTS 4
+#endif
+#define GLFONS__RING_VERTS (GLFONS_RING_SEGMENT_VERTS * GLFONS_RING_SEGMENTS)
+
+// Most programs that can be registered with glfonsRegisterProgram().
+#ifndef GLFONS_MAX_PROGRAMS
+#	define GLFONS_MAX_PROGRAMS 16
+#endif
+
+// Instance buffers start with room for this many bytes and double in size when a draw doesn't fit.
+#ifndef GLFONS_INSTANCE_BUFFER_SIZE
+#	define GLFONS_INSTANCE_BUFFER_SIZE 16384
+#endif
+
+// Persistently mapped buffers need ARB_buffer_storage (loaded using glew). Otherwise the ring is updated with
+// glBufferSubData.
+#if !defined(GLFONTSTASH_IMPLEMENTATION_ES2) && defined(GL_MAP_PERSISTENT_BIT) && defined(GLEW_ARB_buffer_storage)
+#	define GLFONS__PERSISTENT_MAPPING 1
+#else
+#	define GLFONS__PERSISTENT_MAPPING 0
+#endif
+
+// Vertices of a text buffer, or of a draw too large for the ring.
+struct GLFONSbuffer {
+	GLuint buffer;
+	GLuint vertexArray; // Not used if GLFONTSTASH_IMPLEMENTATION_ES2 is defined
+	GLuint instancedArray; // With the text instance attributes, not used if GLFONTSTASH_IMPLEMENTATION_ES2 is defined
+	int nverts;
+};
+typedef struct GLFONSbuffer GLFONSbuffer;
+
+// A program registered with glfonsRegisterProgram() and the locations of the uniforms set by the renderer.
+struct GLFONSprogram {
+	GLuint program;
+	GLint texCoordScale;
+	GLint atlasSize;
+};
+typedef struct GLFONSprogram GLFONSprogram;
+
 struct GLFONScontext {
 	GLuint tex;
 	int width, height;
-	GLuint vertexBuffer;
-	GLuint tcoordBuffer;
-	GLuint colorBuffer;
+	int compact; // Vertices are uploaded as FONScompactVertex.
+	GLuint vertexBuffer; // Ring buffer of interleaved vertices.
 	GLuint vertexArray; // Not used if GLFONTSTASH_IMPLEMENTATION_ES2 is defined
+	int ringHead;
+	int ringSegment;
+	void* ringMapped; // NULL if the ring is not persistently mapped.
+#if GLFONS__PERSISTENT_MAPPING
+	GLsync ringFences[GLFONS_RING_SEGMENTS];
+#endif
+	GLuint instanceBuffer; // Not used if GLFONTSTASH_IMPLEMENTATION_ES2 is defined
+	GLsizeiptr instanceBufferSize;
+	GLuint instanceArray; // Not used if GLFONTSTASH_IMPLEMENTATION_ES2 is defined
+	GLuint textInstanceBuffer; // Not used if GLFONTSTASH_IMPLEMENTATION_ES2 is defined
+	GLsizeiptr textInstanceBufferSize;
+	GLFONSbuffer large; // Draws that don't fit in a ring segment.
+	GLFONSbuffer* buffers;
+	int nbuffers;
+	FONScompactVertex* packed; // Compact vertices waiting to be uploaded.
+	int cpacked;
+	GLFONSprogram programs[GLFONS_MAX_PROGRAMS];
+	int nprograms;
 };
 typedef struct GLFONScontext GLFONScontext;
 
+static GLsizeiptr glfons__vertexSize(GLFONScontext* gl)
+{
+	return gl->compact ? sizeof(FONScompactVertex) : sizeof(FONSvertex);
+}
+
+static void glfons__setVertexAttribs(GLFONScontext* gl)
+{
+	if (gl->compact) {
+		// The shader scales the texel coordinates with 'texCoordScale'.
+		glEnableVertexAttribArray(GLFONS_VERTEX_ATTRIB);
+		glVertexAttribPointer(GLFONS_VERTEX_ATTRIB, 2, GL_SHORT, GL_FALSE, sizeof(FONScompactVertex), NULL);
+
+		glEnableVertexAttribArray(GLFONS_TCOORD_ATTRIB);
+		glVertexAttribPointer(GLFONS_TCOORD_ATTRIB, 2, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(FONScompactVertex), (const GLvoid*)(2 * sizeof(short)));
+
+		glEnableVertexAttribArray(GLFONS_COLOR_ATTRIB);
+		glVertexAttribPointer(GLFONS_COLOR_ATTRIB, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(FONScompactVertex), (const GLvoid*)(4 * sizeof(short)));
+		return;
+	}
+
+	glEnableVertexAttribArray(GLFONS_VERTEX_ATTRIB);
+	glVertexAttribPointer(GLFONS_VERTEX_ATTRIB, 2, GL_FLOAT, GL_FALSE, sizeof(FONSvertex), NULL);
+
+	glEnableVertexAttribArray(GLFONS_TCOORD_ATTRIB);
+	glVertexAttribPointer(GLFONS_TCOORD_ATTRIB, 2, GL_FLOAT, GL_FALSE, sizeof(FONSvertex), (const GLvoid*)(2 * sizeof(float)));
+
+	glEnableVertexAttribArray(GLFONS_COLOR_ATTRIB);
+	glVertexAttribPointer(GLFONS_COLOR_ATTRIB, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(FONSvertex), (const GLvoid*)(4 * sizeof(float)));
+}
+
+static void glfons__disableVertexAttribs(void)
+{
+	glDisableVertexAttribArray(GLFONS_VERTEX_ATTRIB);
+	glDisableVertexAttribArray(GLFONS_TCOORD_ATTRIB);
+	glDisableVertexAttribArray(GLFONS_COLOR_ATTRIB);
+}
+
+static int glfons__createRing(GLFONScontext* gl)
+{
+	GLsizeiptr size = GLFONS__RING_VERTS * glfons__vertexSize(gl);
+
+	glGenBuffers(1, &gl->vertexBuffer);
+	if (!gl->vertexBuffer) return 0;
+	glBindBuffer(GL_ARRAY_BUFFER, gl->vertexBuffer);
+
+#if GLFONS__PERSISTENT_MAPPING
+	if (GLEW_ARB_buffer_storage) {
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+		gl->ringMapped = glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+		if (gl->ringMapped != NULL)
+			return 1;
+
+		// Buffer storage is immutable, start over with a normal buffer.
+		glDeleteBuffers(1, &gl->vertexBuffer);
+		glGenBuffers(1, &gl->vertexBuffer);
+		if (!gl->vertexBuffer) return 0;
+		glBindBuffer(GL_ARRAY_BUFFER, gl->vertexBuffer);
+	}
+#endif
+
+	glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+	return 1;
+}
+
+// Called when the ring moves to the next segment. The vertex buffer needs to be bound.
+static void glfons__ringEnterSegment(GLFONScontext* gl, int segment)
+{
+#if GLFONS__PERSISTENT_MAPPING
+	if (gl->ringMapped != NULL) {
+		// Fence the draws from the segment we are leaving and wait until the GPU is done with the next one.
+		GLsync fence = gl->ringFences[segment];
+		if (gl->ringFences[gl->ringSegment] == 0)
+			gl->ringFences[gl->ringSegment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		if (fence != 0) {
+			while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}
+			glDeleteSync(fence);
+			gl->ringFences[segment] = 0;
+		}
+		gl->ringSegment = segment;
+		return;
+	}
+#endif
+
+	// Orphan the buffer when wrapping around, so that updates don't need to wait for pending draws.
+	if (segment == 0)
+		glBufferData(GL_ARRAY_BUFFER, GLFONS__RING_VERTS * glfons__vertexSize(gl), NULL, GL_STREAM_DRAW);
+	gl->ringSegment = segment;
+}
+
+// Returns the first vertex of free space for 'nverts' vertices.
+static int glfons__ringAlloc(GLFONScontext* gl, int nverts)
+{
+	int segment = gl->ringHead / GLFONS_RING_SEGMENT_VERTS;
+	if (gl->ringHead + nverts > (segment+1) * GLFONS_RING_SEGMENT_VERTS) {
+		segment = (segment+1) % GLFONS_RING_SEGMENTS;
+		gl->ringHead = segment * GLFONS_RING_SEGMENT_VERTS;
+	}
+	if (segment != gl->ringSegment)
+		glfons__ringEnterSegment(gl, segment);
+	return gl->ringHead;
+}
+
+// Sets the uniforms of a registered program, the program needs to be in use.
+static void glfons__setProgramUniforms(GLFONScontext* gl, const GLFONSprogram* p)
+{
+	// Compact vertices have the texture coordinates in texels, normalize them with the atlas size.
+	if (p->texCoordScale != -1) {
+		if (gl->compact)
+			glUniform2f(p->texCoordScale, 1.0f / gl->width, 1.0f / gl->height);
+		else
+			glUniform2f(p->texCoordScale, 1.0f, 1.0f);
+	}
+	if (p->atlasSize != -1)
+		glUniform2f(p->atlasSize, (float)gl->width, (float)gl->height);
+}
+
+// Sets the uniforms of all registered programs after the atlas changed size, and forgets the deleted programs.
+static void glfons__updatePrograms(GLFONScontext* gl)
+{
+	GLint current = 0;
+	int i, n = 0;
+	if (gl->nprograms == 0) return;
+
+	glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+	for (i = 0; i < gl->nprograms; i++) {
+		if (!glIsProgram(gl->programs[i].program)) continue;
+		gl->programs[n] = gl->programs[i];
+		glUseProgram(gl->programs[n].program);
+		glfons__setProgramUniforms(gl, &gl->programs[n]);
+		n++;
+	}
+	gl->nprograms = n;
+	glUseProgram((GLuint)current);
+}
+
+#ifndef GLFONTSTASH_IMPLEMENTATION_ES2
+// Uploads a draw worth of instances to the start of a buffer, which is only reallocated when it needs to grow.
+static void glfons__uploadInstances(GLuint buffer, GLsizeiptr* bufferSize, const void* data, GLsizeiptr size)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	if (size > *bufferSize) {
+		GLsizeiptr newSize = *bufferSize > 0 ? *bufferSize : GLFONS_INSTANCE_BUFFER_SIZE;
+		while (newSize < size) newSize *= 2;
+		glBufferData(GL_ARRAY_BUFFER, newSize, NULL, GL_STREAM_DRAW);
+		*bufferSize = newSize;
+	}
+	glBufferSubData(GL_ARRAY_BUFFER, 0, size, data);
+}
+#endif
+
 static int glfons__renderCreate(void* userPtr, int width, int height)
 {
 	GLFONScontext* gl = (GLFONScontext*)userPtr;
@@ -79,14 +324,44 @@ static int glfons__renderCreate(void* userPtr, int width, int height)
 	glBindVertexArray(gl->vertexArray);
 #endif
 
-	if (!gl->vertexBuffer) glGenBuffers(1, &gl->vertexBuffer);
-	if (!gl->vertexBuffer) return 0;
+	if (!gl->vertexBuffer) {
+		if (!glfons__createRing(gl)) return 0;
+#ifndef GLFONTSTASH_IMPLEMENTATION_ES2
+		// The ring buffer never changes, the vertex array can hold the attribute setup.
+		glfons__setVertexAttribs(gl);
+		glBindVertexArray(0);
+#endif
+	}
+
+#ifndef GLFONTSTASH_IMPLEMENTATION_ES2
+	if (!gl->instanceBuffer) {
+		glGenVertexArrays(1, &gl->instanceArray);
+		if (!gl->instanceArray) return 0;
+		glGenBuffers(1, &gl->instanceBuffer);
+		if (!gl->instanceBuffer) return 0;
+
+		glBindVertexArray(gl->instanceArray);
+		glBindBuffer(GL_ARRAY_BUFFER, gl->instanceBuffer);
+
+		glEnableVertexAttribArray(GLFONS_INSTANCE_POSITION_ATTRIB);
+		glVertexAttribPointer(GLFONS_INSTANCE_POSITION_ATTRIB, 2, GL_FLOAT, GL_FALSE, sizeof(FONSinstance), NULL);
+		glVertexAttribDivisor(GLFONS_INSTANCE_POSITION_ATTRIB, 1);
+
+		glEnableVertexAttribArray(GLFONS_INSTANCE_SIZE_ATTRIB);
+		glVertexAttribPointer(GLFONS_INSTANCE_SIZE_ATTRIB, 2, GL_FLOAT, GL_FALSE, sizeof(FONSinstance), (const GLvoid*)(2 * sizeof(float)));
+		glVertexAttribDivisor(GLFONS_INSTANCE_SIZE_ATTRIB, 1);
 
-	if (!gl->tcoordBuffer) glGenBuffers(1, &gl->tcoordBuffer);
-	if (!gl->tcoordBuffer) return 0;
+		glEnableVertexAttribArray(GLFONS_INSTANCE_TCOORD_ATTRIB);
+		glVertexAttribPointer(GLFONS_INSTANCE_TCOORD_ATTRIB, 4, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(FONSinstance), (const GLvoid*)(4 * sizeof(float)));
+		glVertexAttribDivisor(GLFONS_INSTANCE_TCOORD_ATTRIB, 1);
 
-	if (!gl->colorBuffer) glGenBuffers(1, &gl->colorBuffer);
-	if (!gl->colorBuffer) return 0;
+		glEnableVertexAttribArray(GLFONS_INSTANCE_COLOR_ATTRIB);
+		glVertexAttribPointer(GLFONS_INSTANCE_COLOR_ATTRIB, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(FONSinstance), (const GLvoid*)(4 * sizeof(float) + 4 * sizeof(short)));
+		glVertexAttribDivisor(GLFONS_INSTANCE_COLOR_ATTRIB, 1);
+
+		glBindVertexArray(0);
+	}
+#endif
 
 	gl->width = width;
 	gl->height = height;
@@ -104,6 +379,7 @@ static int glfons__renderCreate(void* userPtr, int width, int height)
 	glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzleRgbaParams);
 #endif
 
+	glfons__updatePrograms(gl);
 	return 1;
 }
 
@@ -160,48 +436,285 @@ static void glfons__renderUpdate(void* userPtr, int* rect, const unsigned char*
 
 }
 
-static void glfons__renderDraw(void* userPtr, const float* verts, const float* tcoords, const unsigned int* colors, int nverts)
+static __inline short glfons__packPosition(float v)
+{
+	if (v < -32768.0f) return -32768;
+	if (v > 32767.0f) return 32767;
+	return (short)(v < 0.0f ? v - 0.5f : v + 0.5f);
+}
+
+static void glfons__packVertices(GLFONScontext* gl, FONScompactVertex* dst, const FONSvertex* src, int nverts)
+{
+	int i;
+	float w = (float)gl->width, h = (float)gl->height;
+	for (i = 0; i < nverts; i++) {
+		dst[i].x = glfons__packPosition(src[i].x);
+		dst[i].y = glfons__packPosition(src[i].y);
+		dst[i].s = (unsigned short)(src[i].s * w + 0.5f);
+		dst[i].t = (unsigned short)(src[i].t * h + 0.5f);
+		dst[i].color = src[i].color;
+	}
+}
+
+// Packs the vertices to temporary memory for uploading.
+static const FONScompactVertex* glfons__packTemp(GLFONScontext* gl, const FONSvertex* verts, int nverts)
+{
+	if (nverts > gl->cpacked) {
+		FONScompactVertex* packed = (FONScompactVertex*)realloc(gl->packed, sizeof(FONScompactVertex) * nverts);
+		if (packed == NULL) return NULL;
+		gl->packed = packed;
+		gl->cpacked = nverts;
+	}
+	glfons__packVertices(gl, gl->packed, verts, nverts);
+	return gl->packed;
+}
+
+static int glfons__uploadBuffer(GLFONScontext* gl, GLFONSbuffer* b, const FONSvertex* verts, int nverts, GLenum usage)
+{
+	const void* data = verts;
+
+	if (!b->buffer) glGenBuffers(1, &b->buffer);
+	if (!b->buffer) return 0;
+
+#ifndef GLFONTSTASH_IMPLEMENTATION_ES2
+	if (!b->vertexArray) {
+		glGenVertexArrays(1, &b->vertexArray);
+		if (!b->vertexArray) return 0;
+
+		glBindVertexArray(b->vertexArray);
+		glBindBuffer(GL_ARRAY_BUFFER, b->buffer);
+		glfons__setVertexAttribs(gl);
+		glBindVertexArray(0);
+	}
+#endif
+
+	if (gl->compact) {
+		data = glfons__packTemp(gl, verts, nverts);
+		if (data == NULL) return 0;
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, b->buffer);
+	glBufferData(GL_ARRAY_BUFFER, nverts * glfons__vertexSize(gl), data, usage);
+
+	b->nverts = nverts;
+	return 1;
+}
+
+static void glfons__drawBuffer(GLFONScontext* gl, GLFONSbuffer* b)
+{
+	if (b->buffer == 0 || b->nverts == 0) return;
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, gl->tex);
+
+#ifdef GLFONTSTASH_IMPLEMENTATION_ES2
+	glBindBuffer(GL_ARRAY_BUFFER, b->buffer);
+	glfons__setVertexAttribs(gl);
+
+	glDrawArrays(GL_TRIANGLES, 0, b->nverts);
+
+	glfons__disableVertexAttribs();
+#else
+	glBindVertexArray(b->vertexArray);
+	glDrawArrays(GL_TRIANGLES, 0, b->nverts);
+	glBindVertexArray(0);
+#endif
+}
+
+static void glfons__deleteBuffer(GLFONSbuffer* b)
+{
+	if (b->buffer != 0) {
+		glDeleteBuffers(1, &b->buffer);
+		b->buffer = 0;
+	}
+
+#ifndef GLFONTSTASH_IMPLEMENTATION_ES2
+	if (b->vertexArray != 0) {
+		glDeleteVertexArrays(1, &b->vertexArray);
+		b->vertexArray = 0;
+	}
+	if (b->instancedArray != 0) {
+		glDeleteVertexArrays(1, &b->instancedArray);
+		b->instancedArray = 0;
+	}
+#endif
+	b->nverts = 0;
+}
+
+// Returns true if the vertices were written directly to the head of the mapped ring.
+static int glfons__isRingHead(GLFONScontext* gl, const FONSvertex* verts)
+{
+	return gl->ringMapped != NULL && !gl->compact && verts == (FONSvertex*)gl->ringMapped + gl->ringHead;
+}
+
+// Fontstash writes FONSvertex, so with compact vertices nothing is written to the ring directly. The vertices
+// are packed into the mapped ring when drawn instead, which still saves the staging copy of glBufferSubData.
+static FONSvertex* glfons__renderMapVertices(void* userPtr, int nverts)
+{
+	GLFONScontext* gl = (GLFONScontext*)userPtr;
+	if (gl->ringMapped == NULL || gl->compact || nverts > GLFONS_RING_SEGMENT_VERTS) return NULL;
+
+	// The space is taken into use in renderDraw.
+	return (FONSvertex*)gl->ringMapped + glfons__ringAlloc(gl, nverts);
+}
+
+static void glfons__renderDraw(void* userPtr, const FONSvertex* verts, int nverts)
 {
 	GLFONScontext* gl = (GLFONScontext*)userPtr;
+	int first, count;
+
+	// Large draws (e.g. a long document) are uploaded in one go to a separate buffer, instead of splitting
+	// them over the ring segments.
+	if (nverts > GLFONS_RING_SEGMENT_VERTS && !glfons__isRingHead(gl, verts)) {
+		if (gl->tex != 0 && glfons__uploadBuffer(gl, &gl->large, verts, nverts, GL_STREAM_DRAW))
+			glfons__drawBuffer(gl, &gl->large);
+		return;
+	}
+
 #ifdef GLFONTSTASH_IMPLEMENTATION_ES2
 	if (gl->tex == 0) return;
+
+	glBindBuffer(GL_ARRAY_BUFFER, gl->vertexBuffer);
+	glfons__setVertexAttribs(gl);
 #else
 	if (gl->tex == 0 || gl->vertexArray == 0) return;
 
 	glBindVertexArray(gl->vertexArray);
+	glBindBuffer(GL_ARRAY_BUFFER, gl->vertexBuffer);
 #endif
 
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, gl->tex);
 
-	glEnableVertexAttribArray(GLFONS_VERTEX_ATTRIB);
-	glBindBuffer(GL_ARRAY_BUFFER, gl->vertexBuffer);
-	glBufferData(GL_ARRAY_BUFFER, nverts * 2 * sizeof(float), verts, GL_DYNAMIC_DRAW);
-	glVertexAttribPointer(GLFONS_VERTEX_ATTRIB, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+	if (glfons__isRingHead(gl, verts)) {
+		// Vertices were written directly to the mapped ring.
+		glDrawArrays(GL_TRIANGLES, gl->ringHead, nverts);
+		gl->ringHead += nverts;
+	} else {
+		// Copy to the ring, whole triangles at a time.
+		while (nverts > 0) {
+			count = fons__mini(nverts, GLFONS_RING_SEGMENT_VERTS - GLFONS_RING_SEGMENT_VERTS % 3);
+			first = glfons__ringAlloc(gl, count);
+			if (gl->compact && gl->ringMapped != NULL) {
+				glfons__packVertices(gl, (FONScompactVertex*)gl->ringMapped + first, verts, count);
+			} else if (gl->compact) {
+				const FONScompactVertex* packed = glfons__packTemp(gl, verts, count);
+				if (packed == NULL) break;
+				glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(FONScompactVertex), count * sizeof(FONScompactVertex), packed);
+			} else if (gl->ringMapped != NULL) {
+				memcpy((FONSvertex*)gl->ringMapped + first, verts, count * sizeof(FONSvertex));
+			} else {
+				glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(FONSvertex), count * sizeof(FONSvertex), verts);
+			}
+			glDrawArrays(GL_TRIANGLES, first, count);
+			gl->ringHead = first + count;
+			verts += count;
+			nverts -= count;
+		}
+	}
 
-	glEnableVertexAttribArray(GLFONS_TCOORD_ATTRIB);
-	glBindBuffer(GL_ARRAY_BUFFER, gl->tcoordBuffer);
-	glBufferData(GL_ARRAY_BUFFER, nverts * 2 * sizeof(float), tcoords, GL_DYNAMIC_DRAW);
-	glVertexAttribPointer(GLFONS_TCOORD_ATTRIB, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+#ifdef GLFONTSTASH_IMPLEMENTATION_ES2
+	glfons__disableVertexAttribs();
+#else
+	glBindVertexArray(0);
+#endif
+}
 
-	glEnableVertexAttribArray(GLFONS_COLOR_ATTRIB);
-	glBindBuffer(GL_ARRAY_BUFFER, gl->colorBuffer);
-	glBufferData(GL_ARRAY_BUFFER, nverts * sizeof(unsigned int), colors, GL_DYNAMIC_DRAW);
-	glVertexAttribPointer(GLFONS_COLOR_ATTRIB, 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, NULL);
+#ifndef GLFONTSTASH_IMPLEMENTATION_ES2
+static void glfons__renderDrawInstanced(void* userPtr, const FONSinstance* insts, int ninsts)
+{
+	GLFONScontext* gl = (GLFONScontext*)userPtr;
+	if (gl->tex == 0 || gl->instanceArray == 0) return;
 
-	glDrawArrays(GL_TRIANGLES, 0, nverts);
+	// The shader normalizes the texel coordinates with 'atlasSize', set on the registered programs.
+	glBindVertexArray(gl->instanceArray);
+	glfons__uploadInstances(gl->instanceBuffer, &gl->instanceBufferSize, insts, ninsts * sizeof(FONSinstance));
 
-	glDisableVertexAttribArray(GLFONS_VERTEX_ATTRIB);
-	glDisableVertexAttribArray(GLFONS_TCOORD_ATTRIB);
-	glDisableVertexAttribArray(GLFONS_COLOR_ATTRIB);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, gl->tex);
+
+	// Four vertices per instance, the corners are generated from gl_VertexID.
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, ninsts);
+
+	glBindVertexArray(0);
+}
+#endif
+
+static int glfons__renderUpdateBuffer(void* userPtr, int buffer, const FONSvertex* verts, int nverts)
+{
+	GLFONScontext* gl = (GLFONScontext*)userPtr;
+
+	if (buffer >= gl->nbuffers) {
+		GLFONSbuffer* buffers = (GLFONSbuffer*)realloc(gl->buffers, sizeof(GLFONSbuffer) * (buffer+1));
+		if (buffers == NULL) return 0;
+		memset(&buffers[gl->nbuffers], 0, sizeof(GLFONSbuffer) * (buffer+1 - gl->nbuffers));
+		gl->buffers = buffers;
+		gl->nbuffers = buffer+1;
+	}
+	return glfons__uploadBuffer(gl, &gl->buffers[buffer], verts, nverts, GL_STATIC_DRAW);
+}
+
+static void glfons__renderDrawBuffer(void* userPtr, int buffer)
+{
+	GLFONScontext* gl = (GLFONScontext*)userPtr;
+	if (gl->tex == 0 || buffer < 0 || buffer >= gl->nbuffers) return;
+	glfons__drawBuffer(gl, &gl->buffers[buffer]);
+}
 
 #ifndef GLFONTSTASH_IMPLEMENTATION_ES2
+static void glfons__renderDrawBufferInstances(void* userPtr, int buffer, const FONStextInstance* instances, int ninstances)
+{
+	GLFONScontext* gl = (GLFONScontext*)userPtr;
+	GLFONSbuffer* b;
+	if (gl->tex == 0 || buffer < 0 || buffer >= gl->nbuffers) return;
+	b = &gl->buffers[buffer];
+	if (b->buffer == 0 || b->nverts == 0) return;
+
+	if (!gl->textInstanceBuffer) glGenBuffers(1, &gl->textInstanceBuffer);
+	if (!gl->textInstanceBuffer) return;
+
+	// The buffer vertices and the instances in one vertex array, created on first use.
+	if (!b->instancedArray) {
+		glGenVertexArrays(1, &b->instancedArray);
+		if (!b->instancedArray) return;
+
+		glBindVertexArray(b->instancedArray);
+		glBindBuffer(GL_ARRAY_BUFFER, b->buffer);
+		glfons__setVertexAttribs(gl);
+
+		glBindBuffer(GL_ARRAY_BUFFER, gl->textInstanceBuffer);
+		glEnableVertexAttribArray(GLFONS_TEXT_INSTANCE_TRANSFORM_ATTRIB);
+		glVertexAttribPointer(GLFONS_TEXT_INSTANCE_TRANSFORM_ATTRIB, 3, GL_FLOAT, GL_FALSE, sizeof(FONStextInstance), NULL);
+		glVertexAttribDivisor(GLFONS_TEXT_INSTANCE_TRANSFORM_ATTRIB, 1);
+
+		glEnableVertexAttribArray(GLFONS_TEXT_INSTANCE_COLOR_ATTRIB);
+		glVertexAttribPointer(GLFONS_TEXT_INSTANCE_COLOR_ATTRIB, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(FONStextInstance), (const GLvoid*)(3 * sizeof(float)));
+		glVertexAttribDivisor(GLFONS_TEXT_INSTANCE_COLOR_ATTRIB, 1);
+
+		glBindVertexArray(0);
+	}
+
+	glfons__uploadInstances(gl->textInstanceBuffer, &gl->textInstanceBufferSize, instances, ninstances * sizeof(FONStextInstance));
+
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, gl->tex);
+
+	glBindVertexArray(b->instancedArray);
+	glDrawArraysInstanced(GL_TRIANGLES, 0, b->nverts, ninstances);
 	glBindVertexArray(0);
+}
 #endif
+
+static void glfons__renderDeleteBuffer(void* userPtr, int buffer)
+{
+	GLFONScontext* gl = (GLFONScontext*)userPtr;
+	if (buffer < 0 || buffer >= gl->nbuffers) return;
+	glfons__deleteBuffer(&gl->buffers[buffer]);
 }
 
 static void glfons__renderDelete(void* userPtr)
 {
+	int i;
 	GLFONScontext* gl = (GLFONScontext*)userPtr;
 	if (gl->tex != 0) {
 		glDeleteTextures(1, &gl->tex);
@@ -212,19 +725,20 @@ static void glfons__renderDelete(void* userPtr)
 	glBindVertexArray(0);
 #endif
 
+#if GLFONS__PERSISTENT_MAPPING
+	for (i = 0; i < GLFONS_RING_SEGMENTS; i++) {
+		if (gl->ringFences[i] != 0) {
+			glDeleteSync(gl->ringFences[i]);
+			gl->ringFences[i] = 0;
+		}
+	}
+#endif
+
+	// Deleting the buffer also unmaps it.
 	if (gl->vertexBuffer != 0) {
 		glDeleteBuffers(1, &gl->vertexBuffer);
 		gl->vertexBuffer = 0;
-	}
-
-	if (gl->tcoordBuffer != 0) {
-		glDeleteBuffers(1, &gl->tcoordBuffer);
-		gl->tcoordBuffer = 0;
-	}
-
-	if (gl->colorBuffer != 0) {
-		glDeleteBuffers(1, &gl->colorBuffer);
-		gl->colorBuffer = 0;
+		gl->ringMapped = NULL;
 	}
 
 #ifndef GLFONTSTASH_IMPLEMENTATION_ES2
@@ -232,8 +746,32 @@ static void glfons__renderDelete(void* userPtr)
 		glDeleteVertexArrays(1, &gl->vertexArray);
 		gl->vertexArray = 0;
 	}
+
+	if (gl->instanceBuffer != 0) {
+		glDeleteBuffers(1, &gl->instanceBuffer);
+		gl->instanceBuffer = 0;
+		gl->instanceBufferSize = 0;
+	}
+
+	if (gl->instanceArray != 0) {
+		glDeleteVertexArrays(1, &gl->instanceArray);
+		gl->instanceArray = 0;
+	}
+
+	if (gl->textInstanceBuffer != 0) {
+		glDeleteBuffers(1, &gl->textInstanceBuffer);
+		gl->textInstanceBuffer = 0;
+		gl->textInstanceBufferSize = 0;
+	}
 #endif
 
+	glfons__deleteBuffer(&gl->large);
+
+	for (i = 0; i < gl->nbuffers; i++)
+		glfons__renderDeleteBuffer(gl, i);
+	if (gl->buffers != NULL) free(gl->buffers);
+	if (gl->packed != NULL) free(gl->packed);
+
 	free(gl);
 }
 
@@ -245,6 +783,7 @@ FONS_DEF FONScontext* glfonsCreate(int width, int height, int flags)
 	gl = (GLFONScontext*)malloc(sizeof(GLFONScontext));
 	if (gl == NULL) goto error;
 	memset(gl, 0, sizeof(GLFONScontext));
+	gl->compact = (flags & FONS_COMPACT_VERTICES) != 0;
 
 	memset(&params, 0, sizeof(params));
 	params.width = width;
@@ -255,6 +794,14 @@ FONS_DEF FONScontext* glfonsCreate(int width, int height, int flags)
 	params.renderUpdate = glfons__renderUpdate;
 	params.renderDraw = glfons__renderDraw; 
 	params.renderDelete = glfons__renderDelete;
+	params.renderMapVertices = glfons__renderMapVertices;
+	params.renderUpdateBuffer = glfons__renderUpdateBuffer;
+	params.renderDrawBuffer = glfons__renderDrawBuffer;
+	params.renderDeleteBuffer = glfons__renderDeleteBuffer;
+#ifndef GLFONTSTASH_IMPLEMENTATION_ES2
+	params.renderDrawInstanced = glfons__renderDrawInstanced;
+	params.renderDrawBufferInstances = glfons__renderDrawBufferInstances;
+#endif
 	params.userPtr = gl;
 
 	return fonsCreateInternal(&params);
@@ -269,6 +816,34 @@ FONS_DEF void glfonsDelete(FONScontext* ctx)
 	fonsDeleteInternal(ctx);
 }
 
+FONS_DEF int glfonsRegisterProgram(FONScontext* ctx, unsigned int program)
+{
+	GLFONScontext* gl = (GLFONScontext*)ctx->params.userPtr;
+	GLFONSprogram* p = NULL;
+	GLint current = 0;
+	int i;
+
+	for (i = 0; i < gl->nprograms; i++) {
+		if (gl->programs[i].program == program) {
+			p = &gl->programs[i];
+			break;
+		}
+	}
+	if (p == NULL) {
+		if (gl->nprograms >= GLFONS_MAX_PROGRAMS) return 0;
+		p = &gl->programs[gl->nprograms++];
+		p->program = program;
+	}
+	p->texCoordScale = glGetUniformLocation(program, "texCoordScale");
+	p->atlasSize = glGetUniformLocation(program, "atlasSize");
+
+	glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+	glUseProgram(program);
+	glfons__setProgramUniforms(gl, p);
+	glUseProgram((GLuint)current);
+	return 1;
+}
+
 FONS_DEF unsigned int glfonsRGBA(unsigned char r, unsigned char g, unsigned char b, unsigned char a)
 {
 	return (r) | (g << 8) | (b << 16) | (a << 24);
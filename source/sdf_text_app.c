@@ -20,6 +20,7 @@ freely, subject to the following restrictions:
 
 #include "fontstash.h"
 #include "gl3corefontstash.h"
+#include "text_document.h"
 
 #include "okwrapper/oklog.h"
 #include "okwrapper/okapp.h"
@@ -27,6 +28,7 @@ freely, subject to the following restrictions:
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 
 // Most SDL functionality is behind a simple wrapper, except for the key constants.
@@ -34,6 +36,17 @@ freely, subject to the following restrictions:
 
 #define LOG_TAG "sdf_text_app"
 
+// A grid of labels drawn from one text buffer.
+#define LABEL_COLUMNS 10
+#define LABEL_ROWS 4
+
+// Dynamic text is drawn as one instance per glyph, except on OpenGL ES2 that doesn't support instancing.
+#if OKGL_OPENGL_ES && (OKGL_OPENGL_ES_MAJOR_VERSION == 2)
+#define USE_INSTANCING 0
+#else
+#define USE_INSTANCING 1
+#endif
+
 uint64_t timeOffsetMicros = 0;
 uint64_t timeMicros = 0;
 
@@ -51,6 +64,11 @@ GLuint shaderColored = 0;
 GLuint shaderText = 0;
 GLuint shaderTextSdf = 0;
 GLuint shaderTextSdfEffects = 0;
+// Same as shaderText and shaderTextSdf when not using instancing.
+GLuint shaderTextDynamic = 0;
+GLuint shaderTextSdfDynamic = 0;
+// Draws copies of a text buffer. Same as shaderTextSdf when not using instancing.
+GLuint shaderTextSdfLabels = 0;
 
 uint8_t* fontDataDroidSans = NULL;
 uint8_t* fontDataDroidSansJapanese = NULL;
@@ -60,8 +78,44 @@ int fontNormal = FONS_INVALID;
 int fontSdf = FONS_INVALID;
 int fontSdfEffects = FONS_INVALID;
 
+// Static text is laid out once into text buffers.
+int textBufferNormal = FONS_INVALID;
+int textBufferSdf = FONS_INVALID;
+int textBufferSdfEffects = FONS_INVALID;
+int textBufferHelp = FONS_INVALID;
+int textBufferLabel = FONS_INVALID;
+
+// Where the dynamic texts continue after the static text.
+float dynamicTextX = 0.0f;
+float dynamicTextY = 0.0f;
+float fpsTextY = 0.0f;
+float labelsY = 0.0f;
+
+// An optional text file given on the command line, drawn below the other text.
+TextDocument* document = NULL;
+float documentY = 0.0f;
+
+// Dynamic text is batched over the frame and drawn at the end of it, one batch key per shader and transform.
+enum {
+    TEXT_BATCH_SDF = 0,
+    TEXT_BATCH_NORMAL = 1,
+    TEXT_BATCH_COUNT
+};
+
+typedef struct {
+    GLuint program;
+    int font;
+    GLfloat modelView[16];
+} TextBatch;
+
+TextBatch textBatches[TEXT_BATCH_COUNT];
+
 // Fontstash callback function.
 void fontStashError(void* userPointer, int error, int value);
+void fontStashBeginBatch(void* userPointer, int key);
+void documentBeginPage(void* userPointer, float x, float y);
+void setSdfRemap(GLuint program, int font);
+void registerTextPrograms();
 
 
 void releaseShaders() {
@@ -76,6 +130,15 @@ void releaseShaders() {
 
     glDeleteProgram(shaderTextSdfEffects);
     shaderTextSdfEffects = 0;
+
+#if USE_INSTANCING
+    glDeleteProgram(shaderTextDynamic);
+    glDeleteProgram(shaderTextSdfDynamic);
+    glDeleteProgram(shaderTextSdfLabels);
+#endif
+    shaderTextDynamic = 0;
+    shaderTextSdfDynamic = 0;
+    shaderTextSdfLabels = 0;
 }
 
 void loadShaders() {
@@ -117,17 +180,57 @@ void loadShaders() {
     shaderTextSdf = okgl_linkProgram(vShaderText, fShaderTextSdf);
     shaderTextSdfEffects = okgl_linkProgram(vShaderText, fShaderTextSdfEffects);
 
+#if USE_INSTANCING
+    char* vShaderTextInstanced = okapp_loadTextAsset("shaders/text_instanced.v.glsl");
+    shaderTextDynamic = okgl_linkProgram(vShaderTextInstanced, fShaderText);
+    shaderTextSdfDynamic = okgl_linkProgram(vShaderTextInstanced, fShaderTextSdf);
+    free(vShaderTextInstanced);
+
+    char* vShaderTextBufferInstanced = okapp_loadTextAsset("shaders/text_buffer_instanced.v.glsl");
+    shaderTextSdfLabels = okgl_linkProgram(vShaderTextBufferInstanced, fShaderTextSdf);
+    free(vShaderTextBufferInstanced);
+#else
+    shaderTextDynamic = shaderText;
+    shaderTextSdfDynamic = shaderTextSdf;
+    shaderTextSdfLabels = shaderTextSdf;
+#endif
+
     free(vShaderText);
     free(fShaderText);
     free(fShaderTextSdf);
     free(fShaderTextSdfEffects);
+
+    registerTextPrograms();
+}
+
+void registerTextPrograms() {
+    // Fontstash sets the atlas size uniforms of the text shaders, when they are loaded and when the atlas grows.
+    if (fs == NULL) {
+        return;
+    }
+    glfonsRegisterProgram(fs, shaderText);
+    glfonsRegisterProgram(fs, shaderTextSdf);
+    glfonsRegisterProgram(fs, shaderTextSdfEffects);
+    glfonsRegisterProgram(fs, shaderTextDynamic);
+    glfonsRegisterProgram(fs, shaderTextSdfDynamic);
+    glfonsRegisterProgram(fs, shaderTextSdfLabels);
 }
 
 void releaseFonts() {
+    // The document has text buffers in the fontstash context.
+    textDocumentClose(document);
+    document = NULL;
+
     if (fs) {
+        // Also deletes the text buffers.
         glfonsDelete(fs);
         fs = NULL;
     }
+    textBufferNormal = FONS_INVALID;
+    textBufferSdf = FONS_INVALID;
+    textBufferSdfEffects = FONS_INVALID;
+    textBufferHelp = FONS_INVALID;
+    textBufferLabel = FONS_INVALID;
 
     free(fontDataDroidSans);
     fontDataDroidSans = NULL;
@@ -143,7 +246,9 @@ int loadFonts() {
     //
     // Initialize fontstash.
     //
-    fs = glfonsCreate(512, 512, FONS_ZERO_TOPLEFT);
+    // The SDF fonts are normalized so that the basic and the effects fonts share their glyphs in the atlas.
+    // No compact vertices, the SDF tiers scale the glyphs to fractional sizes.
+    fs = glfonsCreate(512, 512, FONS_ZERO_TOPLEFT | FONS_SDF_NORMALIZED | (USE_INSTANCING ? FONS_INSTANCED : 0));
     if (fs == NULL) {
         log_e(LOG_TAG, "Could not create font stash.");
         return 0;
@@ -176,7 +281,8 @@ int loadFonts() {
     //
 
     // Note that we tell fontstash to not free the memory after it's done with the font, because we reuse the
-    // data for multiple fonts.
+    // data for multiple fonts. Fonts added from the same data share the parsed font face, only their glyphs
+    // are rendered separately.
     int callFree = 0;
 
     // Font1: no SDF, not supporting Japanese.
@@ -208,6 +314,19 @@ int loadFonts() {
             return 0;
         }
         fonsAddFallbackFont(fs, fontSdf, fontJPSdf);
+
+        // Zoomed in text is drawn from larger glyphs, rasterized when first needed.
+        const float sdfTiers[] = {32.0f, 64.0f, 128.0f};
+        fonsSetSdfTiers(fs, fontSdf, sdfTiers, 3);
+
+        // Text smaller than this on screen is drawn from the bitmaps of the normal font, the SDF shader draws
+        // them with a single texture lookup. Japanese is drawn from the bitmaps of a plain font of its face.
+        fonsSetHybridFont(fs, fontSdf, fontNormal, 16.0f);
+        if (fonsAddFontSdfMem(fs, "DroidSansJP", fontDataDroidSansJapanese, fontDataDroidSansJapaneseSize, callFree,
+                              noSdf) == FONS_INVALID) {
+            log_e(LOG_TAG, "Could not add japanese font.");
+            return 0;
+        }
     }
 
     // Font3: SDF support, also supporting Japanese.
@@ -233,6 +352,169 @@ int loadFonts() {
     return 1;
 }
 
+int createTextBuffers() {
+    float lineHeight = 0.0f;
+    float x = 0.0f;
+    float y = 0.0f;
+
+    textBufferNormal = fonsCreateTextBuffer(fs);
+    textBufferSdf = fonsCreateTextBuffer(fs);
+    textBufferSdfEffects = fonsCreateTextBuffer(fs);
+    textBufferHelp = fonsCreateTextBuffer(fs);
+    textBufferLabel = fonsCreateTextBuffer(fs);
+    if (textBufferNormal == FONS_INVALID || textBufferSdf == FONS_INVALID ||
+        textBufferSdfEffects == FONS_INVALID || textBufferHelp == FONS_INVALID || textBufferLabel == FONS_INVALID) {
+        log_e(LOG_TAG, "Could not create text buffers.");
+        return 0;
+    }
+
+    {
+        //
+        // Normal text.
+        //
+        fonsClearState(fs);
+        fonsSetFont(fs, fontNormal);
+        fonsSetSize(fs, 65.0f);
+        fonsSetAlign(fs, FONS_ALIGN_LEFT | FONS_ALIGN_TOP);
+        fonsVertMetrics(fs, NULL, NULL, &lineHeight);
+
+        fonsSetColor(fs, glfonsRGBA(255, 0, 0, 255));
+        x = fonsAppendText(fs, textBufferNormal, x, y, "Lorem ", NULL);
+
+        fonsSetColor(fs, glfonsRGBA(255, 255, 0, 255));
+        x = fonsAppendText(fs, textBufferNormal, x, y, "ipsum ", NULL);
+
+        fonsSetColor(fs, glfonsRGBA(255, 0, 0, 255));
+        x = fonsAppendText(fs, textBufferNormal, x, y, "dolor sit amet (not SDF)", NULL);
+
+        x = 0.0f;
+        y += lineHeight;
+    }
+
+    {
+        //
+        // SDF text.
+        //
+        fonsClearState(fs);
+        fonsSetFont(fs, fontSdf);
+        fonsSetSize(fs, 65.0f);
+        fonsSetAlign(fs, FONS_ALIGN_LEFT | FONS_ALIGN_TOP);
+        fonsVertMetrics(fs, NULL, NULL, &lineHeight);
+
+        fonsSetColor(fs, glfonsRGBA(255, 0, 0, 255));
+        x = fonsAppendText(fs, textBufferSdf, x, y, "Lorem ", NULL);
+
+        fonsSetColor(fs, glfonsRGBA(255, 255, 0, 255));
+        x = fonsAppendText(fs, textBufferSdf, x, y, "ipsum ", NULL);
+
+        fonsSetColor(fs, glfonsRGBA(255, 0, 0, 255));
+        x = fonsAppendText(fs, textBufferSdf, x, y, "dolor sit amet (SDF)", NULL);
+
+        // The animated characters are drawn here every frame.
+        dynamicTextX = x;
+        dynamicTextY = y;
+
+        x = 0.0f;
+        y += lineHeight;
+
+        fonsSetColor(fs, glfonsRGBA(102, 255, 204, 255));
+        x = fonsAppendText(fs, textBufferSdf, x, y, "Japanese: 点おやをづ例声念ヒレル試石べ位掲質", NULL);
+
+        x = 0.0f;
+        y += lineHeight;
+
+        fonsSetColor(fs, glfonsRGBA(12, 24, 25, 255));
+        x = fonsAppendText(fs, textBufferSdf, x, y, "Cyrillic: Лорем ипсум долор сит амет, иус ет", NULL);
+
+        x = 0.0f;
+        y += lineHeight;
+    }
+
+    {
+        //
+        // SDF text with some effects.
+        //
+        fonsClearState(fs);
+        fonsSetFont(fs, fontSdfEffects);
+        fonsSetSize(fs, 65.0f);
+        fonsSetAlign(fs, FONS_ALIGN_LEFT | FONS_ALIGN_TOP);
+        fonsVertMetrics(fs, NULL, NULL, &lineHeight);
+
+        fonsSetColor(fs, glfonsRGBA(102, 255, 204, 255));
+        x = fonsAppendText(fs, textBufferSdfEffects, x, y, "Japanese: 点おやをづ例声念ヒレル試石べ位掲質", NULL);
+
+        x = 0.0f;
+        y += lineHeight;
+
+        fonsSetColor(fs, glfonsRGBA(255, 255, 0, 255));
+        x = fonsAppendText(fs, textBufferSdfEffects, x, y, "Drag ", NULL);
+
+        fonsSetColor(fs, glfonsRGBA(255, 0, 0, 255));
+        x = fonsAppendText(fs, textBufferSdfEffects, x, y, "to move", NULL);
+
+        y += lineHeight;
+    }
+
+    {
+        //
+        // A label that is drawn many times, each copy gets its color from the instance.
+        //
+        fonsClearState(fs);
+        fonsSetFont(fs, fontSdf);
+        fonsSetSize(fs, 24.0f);
+        fonsSetAlign(fs, FONS_ALIGN_LEFT | FONS_ALIGN_TOP);
+        fonsSetColor(fs, glfonsRGBA(255, 255, 255, 255));
+        fonsAppendText(fs, textBufferLabel, 0.0f, 0.0f, "label", NULL);
+
+        labelsY = y;
+        documentY = y + LABEL_ROWS * 30.0f;
+    }
+
+    {
+        //
+        // Instruction texts.
+        //
+        fonsClearState(fs);
+        fonsSetFont(fs, fontNormal);
+        fonsSetSize(fs, 20.0f);
+        fonsSetAlign(fs, FONS_ALIGN_LEFT | FONS_ALIGN_TOP);
+        fonsVertMetrics(fs, NULL, NULL, &lineHeight);
+        lineHeight *= 1.2f;
+
+        y = 5.0f;
+
+        const char* helpText = "drag to pan, zoom with mouse wheel\n"
+                "'c' - show font cache\n"
+                "'f' - toggle fullscreen\n"
+                "'r' - reload shaders";
+        FONStextRow rows[8];
+        int nrows = fonsTextBreakLines(fs, helpText, NULL, 400.0f, rows, 8);
+
+        // First draw a shadow.
+        fonsSetColor(fs, glfonsRGBA(0, 0, 0, 255));
+        fonsSetBlur(fs, 3.0f);
+
+        float yStart = y;
+        for (int i = 0; i < 2; ++i) {
+            x = 5.0f;
+            y = yStart;
+
+            for (int row = 0; row < nrows; ++row) {
+                fonsAppendText(fs, textBufferHelp, x, y, rows[row].start, rows[row].end);
+                y += lineHeight;
+            }
+
+            // Draw again without blurring
+            fonsSetColor(fs, glfonsRGBA(255, 255, 255, 255));
+            fonsSetBlur(fs, 0.0f);
+        }
+
+        fpsTextY = y;
+    }
+
+    return 1;
+}
+
 
 //
 // App callbacks.
@@ -252,8 +534,27 @@ void onStart(int argc, char* argv[]) {
 
     loadShaders();
 
-    if (!loadFonts()) {
+    if (!loadFonts() || !createTextBuffers()) {
         okapp_queueQuit();
+        return;
+    }
+    registerTextPrograms();
+
+    // Any argument that isn't an option is a text file to view.
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--", 2) != 0) {
+            document = textDocumentOpen(fs, argv[i]);
+            if (document != NULL) {
+                float lineHeight = 0.0f;
+                fonsClearState(fs);
+                fonsSetFont(fs, fontSdf);
+                fonsSetSize(fs, 20.0f);
+                fonsVertMetrics(fs, NULL, NULL, &lineHeight);
+                textDocumentSetStyle(document, fontSdf, 20.0f, glfonsRGBA(230, 230, 230, 255), lineHeight);
+                log_i(LOG_TAG, "Viewing '%s'.", argv[i]);
+            }
+            break;
+        }
     }
 }
 
@@ -360,16 +661,17 @@ void onRender() {
     // Scale text with time and move with mouse.
     //float scale = (1.01f + cosf(((float) zoomAnimationTime) * 0.7f)) * 2.2f;
     //float scale = 1.0f;
+    float translateX = offsetX + (1.0f - scale) * (windowWidth * 0.5f - offsetX);
+    float translateY = offsetY + (1.0f - scale) * (windowHeight * 0.5f - offsetY);
     okgl_matrixSetscale(modelView, scale, scale, 0.0f);
-    okgl_matrixSetTranslation(modelView,
-                              offsetX + (1.0f - scale) * (windowWidth * 0.5f - offsetX),
-                              offsetY + (1.0f - scale) * (windowHeight * 0.5f - offsetY),
-                              0.0f);
+    okgl_matrixSetTranslation(modelView, translateX, translateY, 0.0f);
 
-    float lineHeight = 0.0f;
     float x = 0.0f;
     float y = 0.0f;
 
+    // Collect the dynamic text until the end of the frame.
+    fonsBeginFrame(fs);
+
     {
         //
         // Draw normal text.
@@ -382,23 +684,7 @@ void onRender() {
         GLint modelViewMatrixLoc = glGetUniformLocation(shaderText, "modelView");
         glUniformMatrix4fv(modelViewMatrixLoc, 1, GL_FALSE, &modelView[0]);
 
-        fonsClearState(fs);
-        fonsSetFont(fs, fontNormal);
-        fonsSetSize(fs, 65.0f);
-        fonsSetAlign(fs, FONS_ALIGN_LEFT | FONS_ALIGN_TOP);
-        fonsVertMetrics(fs, NULL, NULL, &lineHeight);
-
-        fonsSetColor(fs, glfonsRGBA(255, 0, 0, 255));
-        x = fonsDrawText(fs, x, y, "Lorem ", NULL);
-
-        fonsSetColor(fs, glfonsRGBA(255, 255, 0, 255));
-        x = fonsDrawText(fs, x, y, "ipsum ", NULL);
-
-        fonsSetColor(fs, glfonsRGBA(255, 0, 0, 255));
-        x = fonsDrawText(fs, x, y, "dolor sit amet (not SDF)", NULL);
-
-        x = 0.0f;
-        y += lineHeight;
+        fonsDrawTextBuffer(fs, textBufferNormal);
     }
 
     {
@@ -413,41 +699,32 @@ void onRender() {
         GLint modelViewMatrixLoc = glGetUniformLocation(shaderTextSdf, "modelView");
         glUniformMatrix4fv(modelViewMatrixLoc, 1, GL_FALSE, &modelView[0]);
 
+        setSdfRemap(shaderTextSdf, fontSdf);
+
+        fonsDrawTextBuffer(fs, textBufferSdf);
+
+        textBatches[TEXT_BATCH_SDF].program = shaderTextSdfDynamic;
+        textBatches[TEXT_BATCH_SDF].font = fontSdf;
+        memcpy(textBatches[TEXT_BATCH_SDF].modelView, modelView, sizeof(modelView));
+
         fonsClearState(fs);
+        fonsSetBatchKey(fs, TEXT_BATCH_SDF);
         fonsSetFont(fs, fontSdf);
         fonsSetSize(fs, 65.0f);
         fonsSetAlign(fs, FONS_ALIGN_LEFT | FONS_ALIGN_TOP);
-        fonsVertMetrics(fs, NULL, NULL, &lineHeight);
-
         fonsSetColor(fs, glfonsRGBA(255, 0, 0, 255));
-        x = fonsDrawText(fs, x, y, "Lorem ", NULL);
-
-        fonsSetColor(fs, glfonsRGBA(255, 255, 0, 255));
-        x = fonsDrawText(fs, x, y, "ipsum ", NULL);
-
-        fonsSetColor(fs, glfonsRGBA(255, 0, 0, 255));
-        x = fonsDrawText(fs, x, y, "dolor sit amet (SDF)", NULL);
 
+        // Only draw what is inside the window, in the scaled and moved text coordinates.
+        fonsSetClipRect(fs, -translateX / scale, -translateY / scale,
+                        (windowWidth - translateX) / scale, (windowHeight - translateY) / scale);
+        // Text less than two pixels high is drawn as bars.
+        fonsSetGreeking(fs, 2.0f / scale, FONS_GREEK_BARS);
+        fonsSetTransformScale(fs, scale);
 
         char dynamicText[] = {1, '\0', '\0'};
         dynamicText[0] += ((int) (timeSeconds * 10.0)) % 127;
         dynamicText[1] += ((int) (timeSeconds * 15.0)) % 128;
-        x = fonsDrawText(fs, x, y, dynamicText, NULL);
-
-        x = 0.0f;
-        y += lineHeight;
-
-        fonsSetColor(fs, glfonsRGBA(102, 255, 204, 255));
-        x = fonsDrawText(fs, x, y, "Japanese: 点おやをづ例声念ヒレル試石べ位掲質", NULL);
-
-        x = 0.0f;
-        y += lineHeight;
-
-        fonsSetColor(fs, glfonsRGBA(12, 24, 25, 255));
-        x = fonsDrawText(fs, x, y, "Cyrillic: Лорем ипсум долор сит амет, иус ет", NULL);
-
-        x = 0.0f;
-        y += lineHeight;
+        fonsDrawText(fs, dynamicTextX, dynamicTextY, dynamicText, NULL);
     }
 
     {
@@ -465,26 +742,50 @@ void onRender() {
         GLint timeLoc = glGetUniformLocation(shaderTextSdfEffects, "time");
         glUniform1f(timeLoc, timeSeconds);
 
-        fonsClearState(fs);
-        fonsSetFont(fs, fontSdfEffects);
-        fonsSetSize(fs, 65.0f);
-        fonsSetAlign(fs, FONS_ALIGN_LEFT | FONS_ALIGN_TOP);
-        fonsVertMetrics(fs, NULL, NULL, &lineHeight);
+        setSdfRemap(shaderTextSdfEffects, fontSdfEffects);
 
-        fonsSetColor(fs, glfonsRGBA(102, 255, 204, 255));
-        x = fonsDrawText(fs, x, y, "Japanese: 点おやをづ例声念ヒレル試石べ位掲質", NULL);
+        fonsDrawTextBuffer(fs, textBufferSdfEffects);
+    }
 
-        x = 0.0f;
-        y += lineHeight;
+    {
+        //
+        // Draw the label grid with one draw call.
+        //
+        glUseProgram(shaderTextSdfLabels);
 
-        fonsSetColor(fs, glfonsRGBA(255, 255, 0, 255));
-        x = fonsDrawText(fs, x, y, "Drag ", NULL);
+        GLint projectionMatrixLoc = glGetUniformLocation(shaderTextSdfLabels, "projection");
+        glUniformMatrix4fv(projectionMatrixLoc, 1, GL_FALSE, &projection[0]);
 
-        fonsSetColor(fs, glfonsRGBA(255, 0, 0, 255));
-        x = fonsDrawText(fs, x, y, "to move", NULL);
+        GLint modelViewMatrixLoc = glGetUniformLocation(shaderTextSdfLabels, "modelView");
+        glUniformMatrix4fv(modelViewMatrixLoc, 1, GL_FALSE, &modelView[0]);
 
-        x = 0.0f;
-        y += lineHeight;
+        setSdfRemap(shaderTextSdfLabels, fontSdf);
+
+        FONStextInstance labels[LABEL_ROWS * LABEL_COLUMNS];
+        for (int i = 0; i < LABEL_ROWS * LABEL_COLUMNS; ++i) {
+            float phase = timeSeconds * 2.0f + i * 0.4f;
+            labels[i].x = (i % LABEL_COLUMNS) * 80.0f;
+            labels[i].y = labelsY + (i / LABEL_COLUMNS) * 30.0f;
+            labels[i].scale = 1.0f + 0.15f * sinf(phase);
+            labels[i].color = glfonsRGBA((unsigned char) (155 + 100 * sinf(phase)),
+                                         (unsigned char) (155 + 100 * sinf(phase + 2.1f)),
+                                         (unsigned char) (155 + 100 * sinf(phase + 4.2f)), 255);
+        }
+        fonsDrawTextBufferInstances(fs, textBufferLabel, labels, LABEL_ROWS * LABEL_COLUMNS);
+    }
+
+    if (document != NULL) {
+        //
+        // Draw the part of the document that is inside the window.
+        //
+        glUseProgram(shaderTextSdf);
+        setSdfRemap(shaderTextSdf, fontSdf);
+
+        double viewX0 = -translateX / scale;
+        double viewY0 = -translateY / scale - documentY;
+        double viewX1 = viewX0 + windowWidth / scale;
+        double viewY1 = viewY0 + windowHeight / scale;
+        textDocumentDraw(document, viewX0, viewY0, viewX1, viewY1, scale, documentBeginPage, NULL);
     }
 
     // Reset translation and scale.
@@ -523,47 +824,33 @@ void onRender() {
         GLint modelViewMatrixLoc = glGetUniformLocation(shaderText, "modelView");
         glUniformMatrix4fv(modelViewMatrixLoc, 1, GL_FALSE, &modelView[0]);
 
+        fonsDrawTextBuffer(fs, textBufferHelp);
+
+        textBatches[TEXT_BATCH_NORMAL].program = shaderTextDynamic;
+        textBatches[TEXT_BATCH_NORMAL].font = fontNormal;
+        memcpy(textBatches[TEXT_BATCH_NORMAL].modelView, modelView, sizeof(modelView));
+
         fonsClearState(fs);
+        fonsSetBatchKey(fs, TEXT_BATCH_NORMAL);
         fonsSetFont(fs, fontNormal);
         fonsSetSize(fs, 20.0f);
         fonsSetAlign(fs, FONS_ALIGN_LEFT | FONS_ALIGN_TOP);
-        fonsVertMetrics(fs, NULL, NULL, &lineHeight);
-        lineHeight *= 1.2f;
-
-        y = 5.0f;
-
-        // First draw a shadow.
-        fonsSetColor(fs, glfonsRGBA(0, 0, 0, 255));
-        fonsSetBlur(fs, 3.0f);
-
-        float yStart = y;
-        for (int i = 0; i < 2; ++i) {
-            x = 5.0f;
-            y = yStart;
-
-            fonsDrawText(fs, x, y, "drag to pan, zoom with mouse wheel", NULL);
-            y += lineHeight;
-            fonsDrawText(fs, x, y, "'c' - show font cache", NULL);
-            y += lineHeight;
-            fonsDrawText(fs, x, y, "'f' - toggle fullscreen", NULL);
-            y += lineHeight;
-            fonsDrawText(fs, x, y, "'r' - reload shaders", NULL);
-            y += lineHeight;
-
-            // Draw again without blurring
-            fonsSetColor(fs, glfonsRGBA(255, 255, 255, 255));
-            fonsSetBlur(fs, 0.0f);
-        }
 
         // Show fps.
         x = 5.0f;
-        fonsSetColor(fs, glfonsRGBA(57, 57, 57, 255));
+        y = fpsTextY;
         char fps[10];
         snprintf(fps, 10, "%.2f", (1.0f / deltaT));
-        x += fonsDrawText(fs, x, y, "fps: ", NULL);
-        fonsDrawText(fs, x, y, fps, NULL);
+        FONStextSpan fpsSpans[] = {
+                {"fps: ", NULL, glfonsRGBA(57, 57, 57, 255)},
+                {fps, NULL, glfonsRGBA(255, 255, 255, 255)},
+        };
+        fonsDrawTextSpans(fs, x, y, fpsSpans, 2);
     }
 
+    // Draw the batched dynamic text.
+    fonsFlushFrame(fs, fontStashBeginBatch, projection);
+
     glDisable(GL_BLEND);
 }
 
@@ -641,3 +928,37 @@ void fontStashError(void* userPointer, int error, int value) {
             break;
     }
 }
+
+void documentBeginPage(void* userPointer, float x, float y) {
+    // The page position is relative to the top left corner of the window.
+    GLfloat modelView[16];
+    okgl_unitMatrix(modelView);
+    okgl_matrixSetscale(modelView, scale, scale, 0.0f);
+    okgl_matrixSetTranslation(modelView, x * scale, y * scale, 0.0f);
+
+    GLint modelViewMatrixLoc = glGetUniformLocation(shaderTextSdf, "modelView");
+    glUniformMatrix4fv(modelViewMatrixLoc, 1, GL_FALSE, &modelView[0]);
+}
+
+void fontStashBeginBatch(void* userPointer, int key) {
+    const GLfloat* projection = (const GLfloat*) userPointer;
+    const TextBatch* batch = &textBatches[key];
+
+    glUseProgram(batch->program);
+
+    GLint projectionMatrixLoc = glGetUniformLocation(batch->program, "projection");
+    glUniformMatrix4fv(projectionMatrixLoc, 1, GL_FALSE, &projection[0]);
+
+    GLint modelViewMatrixLoc = glGetUniformLocation(batch->program, "modelView");
+    glUniformMatrix4fv(modelViewMatrixLoc, 1, GL_FALSE, &batch->modelView[0]);
+
+    setSdfRemap(batch->program, batch->font);
+}
+
+void setSdfRemap(GLuint program, int font) {
+    // Ignored by the programs without SDF shaders, their location is -1.
+    float remapScale, remapBias;
+    fonsGetSdfRemap(fs, font, &remapScale, &remapBias);
+    GLint sdfRemapLoc = glGetUniformLocation(program, "sdfRemap");
+    glUniform2f(sdfRemapLoc, remapScale, remapBias);
+}
@@ -0,0 +1,492 @@
+/*
+Copyright (c) 2018 Olli Kallioinen
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+#include "text_document.h"
+
+#include "okwrapper/okplatform.h"
+#include "okwrapper/oklog.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+
+#include <SDL_atomic.h>
+#include <SDL_thread.h>
+
+#if OKPLATFORM_WINDOWS
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define LOG_TAG "text_document"
+
+// The line offsets are stored in fixed size chunks that are never moved, so the lines that have already
+// been published can be read while the index keeps growing.
+#define TEXT_DOCUMENT_CHUNK_LINES 65536
+// Bytes of the file that are scanned for line breaks at a time.
+#define TEXT_DOCUMENT_INDEX_STEP (4 * 1024 * 1024)
+// Lines are laid out and cached in pages of this many lines.
+#define TEXT_DOCUMENT_PAGE_LINES 64
+// The most pages that are drawn at once, when zoomed out further only the top of the view is drawn.
+// Zoomed out pages are greeked and cost a quad per word, so this is twice what full glyph pages allowed.
+#define TEXT_DOCUMENT_MAX_PAGES 64
+// Text smaller than this on the screen is drawn as bars, one for each word.
+#define TEXT_DOCUMENT_GREEK_PIXELS 2.0f
+// Longer lines are cut when drawn.
+#define TEXT_DOCUMENT_MAX_LINE_BYTES 1024
+
+typedef struct {
+    int page;
+    // Number of lines the page had when it was laid out, the last page grows while indexing.
+    int nlines;
+    int greeked;
+    // Size the glyphs were rasterized at, zooming may switch the page to another SDF tier.
+    float rasterSize;
+    int buffer;
+    unsigned int lastUsed;
+} TextDocumentPage;
+
+struct TextDocument {
+    FONScontext* fs;
+
+    const char* data;
+    size_t size;
+
+    size_t** chunks;
+    // Number of line starts that can be read, written by the indexer.
+    SDL_atomic_t nstarts;
+    SDL_atomic_t indexed;
+    SDL_atomic_t cancel;
+    SDL_Thread* thread;
+
+    // Owned by the indexer.
+    size_t indexPos;
+    int indexLines;
+
+    int font;
+    float fontSize;
+    unsigned int color;
+    float lineHeight;
+
+    TextDocumentPage pages[TEXT_DOCUMENT_MAX_PAGES];
+    unsigned int frame;
+};
+
+static int textDocument_map(TextDocument* document, const char* fileName) {
+#if OKPLATFORM_WINDOWS
+    LARGE_INTEGER size;
+    HANDLE mapping = NULL;
+    HANDLE file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return 0;
+    }
+    if (!GetFileSizeEx(file, &size) || (unsigned long long) size.QuadPart > (size_t) -1) {
+        CloseHandle(file);
+        return 0;
+    }
+    document->size = (size_t) size.QuadPart;
+
+    // Empty files can't be mapped.
+    if (document->size > 0) {
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping != NULL) {
+            document->data = (const char*) MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            // The view keeps the file open.
+            CloseHandle(mapping);
+        }
+    }
+    CloseHandle(file);
+    return document->size == 0 || document->data != NULL;
+#else
+    struct stat info;
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    if (fstat(fd, &info) != 0 || (unsigned long long) info.st_size > (size_t) -1) {
+        close(fd);
+        return 0;
+    }
+    document->size = (size_t) info.st_size;
+
+    if (document->size > 0) {
+        void* data = mmap(NULL, document->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            document->data = (const char*) data;
+        }
+    }
+    // The mapping stays valid after closing the file.
+    close(fd);
+    return document->size == 0 || document->data != NULL;
+#endif
+}
+
+static void textDocument_unmap(TextDocument* document) {
+    if (document->data == NULL) {
+        return;
+    }
+#if OKPLATFORM_WINDOWS
+    UnmapViewOfFile(document->data);
+#else
+    munmap((void*) document->data, document->size);
+#endif
+    document->data = NULL;
+}
+
+static int textDocument_addLine(TextDocument* document, size_t start) {
+    int line = document->indexLines;
+    if (line == INT_MAX) {
+        return 0;
+    }
+
+    size_t* chunk = document->chunks[line / TEXT_DOCUMENT_CHUNK_LINES];
+    if (chunk == NULL) {
+        chunk = (size_t*) malloc(sizeof(size_t) * TEXT_DOCUMENT_CHUNK_LINES);
+        if (chunk == NULL) {
+            return 0;
+        }
+        document->chunks[line / TEXT_DOCUMENT_CHUNK_LINES] = chunk;
+    }
+    chunk[line % TEXT_DOCUMENT_CHUNK_LINES] = start;
+    document->indexLines++;
+    return 1;
+}
+
+// Indexes the next part of the file and publishes the new lines. Returns 0 when the whole file is indexed.
+static int textDocument_indexStep(TextDocument* document) {
+    const char* data = document->data;
+    size_t end = document->size;
+    if (end - document->indexPos > TEXT_DOCUMENT_INDEX_STEP) {
+        end = document->indexPos + TEXT_DOCUMENT_INDEX_STEP;
+    }
+
+    const char* p = data + document->indexPos;
+    while ((p = (const char*) memchr(p, '\n', (data + end) - p)) != NULL) {
+        p++;
+        // No empty line after the last line break.
+        if (p == data + document->size) {
+            break;
+        }
+        if (!textDocument_addLine(document, (size_t) (p - data))) {
+            // Out of memory, the rest of the file is shown as part of the last line.
+            end = document->size;
+            break;
+        }
+    }
+    document->indexPos = end;
+
+    // Make sure the line offsets are written before they are published.
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&document->nstarts, document->indexLines);
+    if (end == document->size) {
+        SDL_AtomicSet(&document->indexed, 1);
+        return 0;
+    }
+    return 1;
+}
+
+static int textDocument_indexThread(void* userPointer) {
+    TextDocument* document = (TextDocument*) userPointer;
+    while (!SDL_AtomicGet(&document->cancel) && textDocument_indexStep(document)) {
+    }
+    return 0;
+}
+
+// Returns the number of lines that can be read, the end of a line is known only when the next one starts.
+static int textDocument_readableLines(TextDocument* document, int* nstarts) {
+    int indexed = SDL_AtomicGet(&document->indexed);
+    *nstarts = SDL_AtomicGet(&document->nstarts);
+    SDL_MemoryBarrierAcquire();
+    if (indexed) {
+        return *nstarts;
+    }
+    return *nstarts > 0 ? *nstarts - 1 : 0;
+}
+
+static size_t textDocument_lineStart(const TextDocument* document, int line) {
+    return document->chunks[line / TEXT_DOCUMENT_CHUNK_LINES][line % TEXT_DOCUMENT_CHUNK_LINES];
+}
+
+static void textDocument_getLine(const TextDocument* document, int line, int nstarts,
+                                 const char** start, const char** end) {
+    const char* s = document->data + textDocument_lineStart(document, line);
+    const char* e = document->data + document->size;
+    if (line + 1 < nstarts) {
+        e = document->data + textDocument_lineStart(document, line + 1);
+    }
+    if (e > s && e[-1] == '\n') {
+        e--;
+    }
+    if (e > s && e[-1] == '\r') {
+        e--;
+    }
+
+    // Cut long lines, without splitting a UTF-8 sequence.
+    if (e - s > TEXT_DOCUMENT_MAX_LINE_BYTES) {
+        e = s + TEXT_DOCUMENT_MAX_LINE_BYTES;
+        while (e > s && (*e & 0xc0) == 0x80) {
+            e--;
+        }
+    }
+    *start = s;
+    *end = e;
+}
+
+TextDocument* textDocumentOpen(FONScontext* fs, const char* fileName) {
+    TextDocument* document = (TextDocument*) calloc(1, sizeof(TextDocument));
+    if (document == NULL) {
+        return NULL;
+    }
+
+    document->fs = fs;
+    document->font = FONS_INVALID;
+    document->fontSize = 20.0f;
+    document->color = 0xffffffff;
+    document->lineHeight = 24.0f;
+    for (int i = 0; i < TEXT_DOCUMENT_MAX_PAGES; ++i) {
+        document->pages[i].page = -1;
+        document->pages[i].buffer = FONS_INVALID;
+    }
+
+    if (!textDocument_map(document, fileName)) {
+        log_e(LOG_TAG, "Could not open '%s'.", fileName);
+        goto error;
+    }
+
+    // There is at most one line per byte.
+    document->chunks = (size_t**) calloc(document->size / TEXT_DOCUMENT_CHUNK_LINES + 2, sizeof(size_t*));
+    if (document->chunks == NULL) {
+        goto error;
+    }
+
+    if (document->size == 0) {
+        SDL_AtomicSet(&document->indexed, 1);
+        return document;
+    }
+
+    if (!textDocument_addLine(document, 0)) {
+        goto error;
+    }
+    SDL_AtomicSet(&document->nstarts, 1);
+
+    document->thread = SDL_CreateThread(textDocument_indexThread, "text_document_index", document);
+    if (document->thread == NULL) {
+        // Index a part of the file every frame instead.
+        log_w(LOG_TAG, "Could not start the index thread: %s", SDL_GetError());
+    }
+    return document;
+
+error:
+    textDocumentClose(document);
+    return NULL;
+}
+
+void textDocumentClose(TextDocument* document) {
+    if (document == NULL) {
+        return;
+    }
+
+    if (document->thread != NULL) {
+        SDL_AtomicSet(&document->cancel, 1);
+        SDL_WaitThread(document->thread, NULL);
+    }
+
+    for (int i = 0; i < TEXT_DOCUMENT_MAX_PAGES; ++i) {
+        if (document->pages[i].buffer != FONS_INVALID) {
+            fonsDeleteTextBuffer(document->fs, document->pages[i].buffer);
+        }
+    }
+
+    if (document->chunks != NULL) {
+        for (size_t i = 0; i < document->size / TEXT_DOCUMENT_CHUNK_LINES + 2; ++i) {
+            free(document->chunks[i]);
+        }
+        free(document->chunks);
+    }
+    textDocument_unmap(document);
+    free(document);
+}
+
+void textDocumentSetStyle(TextDocument* document, int font, float size, unsigned int color, float lineHeight) {
+    document->font = font;
+    document->fontSize = size;
+    document->color = color;
+    document->lineHeight = lineHeight;
+
+    // Lay out all pages again.
+    for (int i = 0; i < TEXT_DOCUMENT_MAX_PAGES; ++i) {
+        document->pages[i].page = -1;
+    }
+}
+
+int textDocumentLineCount(TextDocument* document) {
+    int nstarts;
+    return textDocument_readableLines(document, &nstarts);
+}
+
+int textDocumentIsIndexed(TextDocument* document) {
+    return SDL_AtomicGet(&document->indexed);
+}
+
+static void textDocument_setState(TextDocument* document, float scale) {
+    FONScontext* fs = document->fs;
+    fonsClearState(fs);
+    fonsSetFont(fs, document->font);
+    fonsSetSize(fs, document->fontSize);
+    fonsSetColor(fs, document->color);
+    fonsSetAlign(fs, FONS_ALIGN_LEFT | FONS_ALIGN_TOP);
+    fonsSetGreeking(fs, TEXT_DOCUMENT_GREEK_PIXELS / scale, FONS_GREEK_BARS);
+    fonsSetTransformScale(fs, scale);
+}
+
+static float textDocument_rasterSize(TextDocument* document, float scale) {
+    fonsPushState(document->fs);
+    textDocument_setState(document, scale);
+    float rasterSize = fonsGetRasterSize(document->fs);
+    fonsPopState(document->fs);
+    return rasterSize;
+}
+
+static int textDocument_layoutPage(TextDocument* document, TextDocumentPage* page, int index,
+                                   int nlines, int nstarts, float scale) {
+    FONScontext* fs = document->fs;
+    if (page->buffer == FONS_INVALID) {
+        page->buffer = fonsCreateTextBuffer(fs);
+        if (page->buffer == FONS_INVALID) {
+            return 0;
+        }
+    }
+    fonsClearTextBuffer(fs, page->buffer);
+
+    int first = index * TEXT_DOCUMENT_PAGE_LINES;
+    int count = nlines - first;
+    if (count > TEXT_DOCUMENT_PAGE_LINES) {
+        count = TEXT_DOCUMENT_PAGE_LINES;
+    }
+
+    fonsPushState(fs);
+    textDocument_setState(document, scale);
+    page->rasterSize = fonsGetRasterSize(fs);
+    for (int i = 0; i < count; ++i) {
+        const char* start;
+        const char* end;
+        textDocument_getLine(document, first + i, nstarts, &start, &end);
+        if (start != end) {
+            fonsAppendText(fs, page->buffer, 0.0f, i * document->lineHeight, start, end);
+        }
+    }
+    fonsPopState(fs);
+
+    page->page = index;
+    page->nlines = count;
+    page->greeked = document->fontSize * scale < TEXT_DOCUMENT_GREEK_PIXELS;
+    return 1;
+}
+
+// Returns the cached page, laid out again if needed.
+static TextDocumentPage* textDocument_getPage(TextDocument* document, int index, int nlines, int nstarts,
+                                              float scale, float rasterSize) {
+    TextDocumentPage* page = NULL;
+    int greeked = document->fontSize * scale < TEXT_DOCUMENT_GREEK_PIXELS;
+    int count = nlines - index * TEXT_DOCUMENT_PAGE_LINES;
+    if (count > TEXT_DOCUMENT_PAGE_LINES) {
+        count = TEXT_DOCUMENT_PAGE_LINES;
+    }
+
+    for (int i = 0; i < TEXT_DOCUMENT_MAX_PAGES; ++i) {
+        if (document->pages[i].page == index) {
+            page = &document->pages[i];
+            break;
+        }
+    }
+
+    if (page == NULL) {
+        // Replace the page that has been unused for the longest time.
+        for (int i = 0; i < TEXT_DOCUMENT_MAX_PAGES; ++i) {
+            TextDocumentPage* candidate = &document->pages[i];
+            if (candidate->page == -1) {
+                page = candidate;
+                break;
+            }
+            if (candidate->lastUsed != document->frame && (page == NULL || candidate->lastUsed < page->lastUsed)) {
+                page = candidate;
+            }
+        }
+        if (page == NULL) {
+            return NULL;
+        }
+        page->page = -1;
+    }
+
+    if (page->page != index || page->nlines != count || page->greeked != greeked ||
+        (!greeked && page->rasterSize != rasterSize)) {
+        if (!textDocument_layoutPage(document, page, index, nlines, nstarts, scale)) {
+            return NULL;
+        }
+    }
+    page->lastUsed = document->frame;
+    return page;
+}
+
+void textDocumentDraw(TextDocument* document, double viewX0, double viewY0, double viewX1, double viewY1,
+                      float scale, TextDocumentBeginPage beginPage, void* userPointer) {
+    if (document->thread == NULL && !SDL_AtomicGet(&document->indexed)) {
+        textDocument_indexStep(document);
+    }
+
+    int nstarts;
+    int nlines = textDocument_readableLines(document, &nstarts);
+    if (nlines == 0 || document->font == FONS_INVALID || document->lineHeight <= 0.0f || scale <= 0.0f) {
+        return;
+    }
+
+    // Find the pages inside the view, this doesn't depend on the size of the document.
+    double pageHeight = (double) document->lineHeight * TEXT_DOCUMENT_PAGE_LINES;
+    if (viewX1 < 0.0 || viewY1 < 0.0 || viewY0 >= (double) document->lineHeight * nlines) {
+        return;
+    }
+    int firstPage = viewY0 > 0.0 ? (int) floor(viewY0 / pageHeight) : 0;
+    int lastPage = (nlines - 1) / TEXT_DOCUMENT_PAGE_LINES;
+    if (viewY1 < (lastPage + 1) * pageHeight) {
+        lastPage = (int) floor(viewY1 / pageHeight);
+    }
+    if (lastPage - firstPage >= TEXT_DOCUMENT_MAX_PAGES) {
+        lastPage = firstPage + TEXT_DOCUMENT_MAX_PAGES - 1;
+    }
+
+    document->frame++;
+    float rasterSize = textDocument_rasterSize(document, scale);
+    for (int i = firstPage; i <= lastPage; ++i) {
+        TextDocumentPage* page = textDocument_getPage(document, i, nlines, nstarts, scale, rasterSize);
+        if (page == NULL) {
+            continue;
+        }
+        if (beginPage != NULL) {
+            beginPage(userPointer, (float) -viewX0, (float) (i * pageHeight - viewY0));
+        }
+        fonsDrawTextBuffer(document->fs, page->buffer);
+    }
+}
@@ -0,0 +1,59 @@
+/*
+Copyright (c) 2018 Olli Kallioinen
+
+This software is provided 'as-is', without any express or implied
+warranty. In no event will the authors be held liable for any damages
+arising from the use of this software.
+
+Permission is granted to anyone to use this software for any purpose,
+including commercial applications, and to alter it and redistribute it
+freely, subject to the following restrictions:
+
+1. The origin of this software must not be misrepresented; you must not
+   claim that you wrote the original software. If you use this software
+   in a product, an acknowledgment in the product documentation would be
+   appreciated but is not required.
+2. Altered source versions must be plainly marked as such, and must not be
+   misrepresented as being the original software.
+3. This notice may not be removed or altered from any source distribution.
+*/
+
+//
+// A viewer for large text documents. The file is memory mapped and the
+// line offsets are indexed in a background thread, so opening a document
+// doesn't have to wait for the whole file to be read. Only the lines that
+// are inside the view are laid out, in pages of lines that are kept in
+// fontstash text buffers while they stay visible. When zoomed out so far
+// that the text can't be read, words are drawn as bars instead.
+//
+
+#ifndef TEXT_DOCUMENT_H_
+#define TEXT_DOCUMENT_H_
+
+#include "fontstash.h"
+
+typedef struct TextDocument TextDocument;
+
+// Called before each visible page is drawn. (x, y) is the origin of the page relative to the top left
+// corner of the view rect, the lines of a page are laid out relative to it so that the float precision
+// doesn't run out in large documents.
+typedef void (*TextDocumentBeginPage)(void* userPointer, float x, float y);
+
+// Returns NULL if the file could not be opened.
+TextDocument* textDocumentOpen(FONScontext* fs, const char* fileName);
+void textDocumentClose(TextDocument* document);
+
+// Lines are drawn with the given font, size and color, each line is lineHeight below the previous one.
+void textDocumentSetStyle(TextDocument* document, int font, float size, unsigned int color, float lineHeight);
+
+// The number of lines indexed so far, grows until the whole file has been indexed.
+int textDocumentLineCount(TextDocument* document);
+int textDocumentIsIndexed(TextDocument* document);
+
+// Draws the lines that intersect the view rect, given in document coordinates where (0, 0) is the top
+// left corner of the first line. Scale is the size of a document unit in pixels. The text buffers are
+// drawn with the currently bound shader.
+void textDocumentDraw(TextDocument* document, double viewX0, double viewY0, double viewX1, double viewY1,
+                      float scale, TextDocumentBeginPage beginPage, void* userPointer);
+
+#endif // ifndef TEXT_DOCUMENT_H_